@@ -1,7 +1,37 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <string>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstring>
+#include <bitset>
+#include <map>
+#include <unordered_map>
+#include <climits>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <chrono>
+#include <cstdio>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_image.h>
@@ -19,13 +49,248 @@ const int DEFAULT_LINE_HEIGHT = 22;
 
 const int SCROLL_BAR_WIDTH = 5;
 const int SCROLL_SPEED = 1;
+const int SCROLL_WHEEL_ROWS = 3;            // a wheel notch glides this far
+const double SCROLL_FRICTION = 10.0;        // per second, the glide slows down as exp(-friction * t)
+const double SCROLL_STOP_SPEED = 4.0;       // pixels per second
+const int TEXT_CACHE_ENTRIES = 4096;
+
+const int MINIMAP_BUCKETS = 16;             // 4 bits each in a line's summary
+const int MINIMAP_BUCKET_COLUMNS = 8;
+const int MINIMAP_WIDTH = 64;
+const int MINIMAP_ROW_PIXELS = 2;           // per line, until the document is taller than the view
+const int MINIMAP_ROWS_MAX = 2048;
+const int MINIMAP_CHUNK_LINES = 16384;
+const int MINIMAP_SYNC_LINES = 4096;
+
+const int STATUS_BAR_HEIGHT = 24;
 
 const int BUTTON_SPAN = 5;
 const int BUTTON_WIDTH = 50;
 
 const int DEFAULT_FONT_SIZE = 16;
 
+const int TAB_SIZE = 4;
+
+const int LAYOUT_CHUNK_LINES = 2048;
+const int SEARCH_CHUNK_LINES = 4096;
+
+const int UNDO_HISTORY_LIMIT = 1000;
+
+const int DFA_STATE_LIMIT = 2048;
+
+const int LEX_LINES_PER_FRAME = 20000;
+
+const char* const JOURNAL_PATH = "./Output/ogmios.journal";
+const char* const AUTOSAVE_UNTITLED_PATH = "./Output/unknow.autosave.txt";
+const int AUTOSAVE_INTERVAL_SECONDS = 30;
+
+const size_t VIEWER_THRESHOLD_DEFAULT = 256 << 20;
+const size_t VIEWER_INDEX_CHUNK_BYTES = 16 << 20;
+const size_t VIEWER_LINE_BYTES_MAX = 4096;
+const int VIEWER_CHECKPOINT_LINES = 1024;
+
+const int RELOAD_DIFF_EDITS_MAX = 512;
+
+const int BROWSER_SCAN_BYTES = 64 * 1024;
+const int BROWSER_ENTRIES_PER_FRAME = 4096;
+
+const int FINDER_CHUNK_PATHS = 65536;
+const int FINDER_RESULTS = 100;
+const int FINDER_COMPACT_MIN = 4096;
+
+const int LOAD_FIRST_LINES = 1024;
+const int LOAD_CHUNK_LINES = 65536;
+
+const int VIEW_MIN_TEXT_WIDTH = 120;
+const int VIEW_MIN_ROWS = 3;
+
 enum themes { DAY, NIGHT, numberOfThemes };
+enum tokens { TOKEN_TEXT, TOKEN_KEYWORD, TOKEN_STRING, TOKEN_NUMBER, TOKEN_COMMENT, numberOfTokens };
+
+// Work-stealing pool: each worker pops its own queue from the back
+// and steals from the front of the others once it runs dry. Tasks submitted by a worker go to its
+// own queue, the other threads spread theirs round-robin.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount) {
+        for (int i = 0; i < threadCount; i++) {
+            queues.push_back(std::make_unique<TaskQueue>());
+        }
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        size_t index = currentPool == this ? currentWorker : nextQueue.fetch_add(1, std::memory_order_relaxed);
+        TaskQueue& queue = *queues[index % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedTasks++;
+        }
+        wakeUp.notify_one();
+    }
+
+    int size() const {
+        return static_cast<int>(threads.size());
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    int queuedTasks = 0;
+    bool stopping = false;
+    std::atomic<size_t> nextQueue{0};
+
+    static thread_local const ThreadPool* currentPool;     // the pool the calling thread works for
+    static thread_local int currentWorker;
+
+    bool take(int self, std::function<void()>& task) {
+        for (size_t k = 0; k < queues.size(); k++) {
+            TaskQueue& queue = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(int self) {
+        currentPool = this;
+        currentWorker = self;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeUp.wait(lock, [this] { return stopping || queuedTasks > 0; });
+                if (stopping) {
+                    return;
+                }
+                queuedTasks--;
+            }
+
+            // A task is reserved for us, it may just sit in a queue we already scanned
+            std::function<void()> task;
+            while (!take(self, task)) {
+                std::this_thread::yield();
+            }
+            task();
+        }
+    }
+};
+
+thread_local const ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local int ThreadPool::currentWorker = 0;
+
+struct LineLayout {
+    std::vector<int> breaks;    // offsets where each wrapped sub-line after the first starts
+    bool dirty = true;
+};
+
+struct LayoutResult {
+    int first;
+    int width;
+    unsigned generation;
+    std::vector<std::vector<int>> breaks;
+};
+
+// Wrap results for a width no view in the globals uses, kept in step with `lines` by every edit
+struct LayoutCache {
+    int width;
+    std::vector<LineLayout> layout;
+    std::vector<int> visualLineStart;
+    int staleFrom;      // visualLineStart is only right up to this line
+    bool pending;       // dirty lines no background task is wrapping
+};
+
+// Outermost run of folded lines: `first` stays in view, first + 1 to `last` are hidden
+struct FoldSpan {
+    int first;
+    int last;
+    int row;        // visual row the lines after it start on
+    int hidden;     // rows hidden by this span and every one before it
+};
+
+struct Span {
+    int start;
+    int length;
+    int token;
+};
+
+struct SearchMatch {
+    int line;
+    int column;
+    int length;
+};
+
+// A cursor with its own selection anchor; `selecting` as for the main cursor
+struct Caret {
+    int x;
+    int y;
+    int anchorX;
+    int anchorY;
+    bool selecting;
+};
+
+// [start, end) between two document positions
+struct TextRange {
+    int startX;
+    int startY;
+    int endX;
+    int endY;
+};
+
+// One editor pane. The one in the globals keeps its state there, see VIEWS
+struct View {
+    double x = 0, y = 0, w = 1, h = 1;  // share of the editor area
+    SDL_Rect frame;                     // in window pixels
+    int cursorX = 0;
+    int cursorY = 0;
+    int topLine = 0;                    // first visible sub-line, which edits and wraps keep meaningful
+    int topRow = 0;
+    double topPixels = 0;
+    double scrollVelocity = 0;
+    bool selectionActive = false;
+    int anchorX = 0;
+    int anchorY = 0;
+    std::vector<Caret> extraCarets;
+};
+
+struct SearchResult {
+    int chunk;
+    unsigned generation;
+    std::vector<SearchMatch> matches;
+};
 
 // Var
 int windowWidth;
@@ -38,9 +303,65 @@ int cursorY = 0;
 int rCursorX;
 int rCursorY;
 int scrollPosition = 0;
+double scrollPixels = 0;        // how far into row scrollPosition the view starts, less than lineHeight
+double scrollVelocity = 0;      // pixels per second left from the wheel
+
+// The selection runs from the anchor to the cursor, in either direction
+bool selectionActive = false;
+int anchorX = 0;
+int anchorY = 0;
+bool mouseSelecting = false;
+
+// Cursors added with Ctrl+click or Ctrl+D, besides the main one
+std::vector<Caret> extraCarets;
 
 int currentFontSize;
 
+bool monospaceFont = false;
+int monospaceAdvance = 0;
+int glyphAdvance[256];
+
+std::unique_ptr<ThreadPool> pool;
+
+// Background readers of `lines` hold it shared, edits take it exclusively
+std::shared_mutex documentMutex;
+
+std::vector<LineLayout> layout;
+std::vector<int> visualLineStart;   // prefix sums of wrapped rows, one more entry than lines
+int layoutWidth;
+std::vector<LayoutCache> layoutCaches;
+
+// Folded regions of the document, from the line left in view to the last one hidden. They may
+// nest; foldSpans is their union, indexed against the rows of the layout in the globals
+std::map<int, int> folds;
+std::vector<FoldSpan> foldSpans;
+
+std::vector<View> views(1);
+int currentView = 0;    // whose state is in the globals, the focused one outside of rendering
+int focusedView = 0;
+
+std::atomic<unsigned> documentVersion(0);
+std::atomic<unsigned> layoutGeneration(0);
+std::atomic<int> layoutTasksPending(0);
+bool backgroundLayoutPending = false;
+std::mutex layoutResultsMutex;
+std::vector<LayoutResult> layoutResults;
+
+bool searchActive = false;
+std::string searchQuery;
+std::string replaceQuery;
+bool searchRegexMode = false;
+bool searchError = false;
+bool replaceActive = false;
+bool replaceFocused = false;
+unsigned searchVersion;
+std::atomic<unsigned> searchGeneration(0);
+std::atomic<int> searchTasksPending(0);
+std::mutex searchResultsMutex;
+std::vector<SearchResult> searchResults;
+std::vector<std::vector<SearchMatch>> searchChunks;    // matches of each SEARCH_CHUNK_LINES block, in order
+int searchMatchCount = 0;
+
 int editorLeftMargin;
 int lineHeight;
 
@@ -49,17 +370,25 @@ int currentTheme;
 SDL_Window* window = nullptr;
 SDL_Renderer* renderer = nullptr;
 TTF_Font* font = nullptr;
+Uint32 dialogEvent = static_cast<Uint32>(-1);    // registered in init, see DIALOG
+bool nativeDialogs = false;                      // OGMIOS_NATIVE_DIALOGS: tinyfiledialogs instead of the built-in browser
 
 SDL_Color fontColor[numberOfThemes];
 SDL_Color cursorColor[numberOfThemes];
 SDL_Color UIColor[numberOfThemes];
 SDL_Color textBackgroundColor[numberOfThemes];
 SDL_Color UIBackgroundColor[numberOfThemes];
+SDL_Color searchHighlightColor[numberOfThemes];
+SDL_Color selectionColor[numberOfThemes];
+SDL_Color bracketColor[numberOfThemes];
+SDL_Color tokenColor[numberOfThemes][numberOfTokens];
 
 SDL_Texture* themesIcons[numberOfThemes];
 
 SDL_Rect UI;
 SDL_Rect viewport;
+SDL_Rect editorArea;    // below the UI bar, shared by the views
+SDL_Rect viewFrame;     // window area of the current view
 
 SDL_Rect scrollBar;
 
@@ -70,6 +399,9 @@ SDL_Rect sizeButtonBox;
 SDL_Rect plusButtonBox;
 SDL_Rect themeButtonBox;
 
+SDL_Rect searchBox;
+SDL_Rect statusBox;
+
 
 SDL_Texture* LoadTexture(const char* fileName) {
     SDL_Surface* tmpSurface = IMG_Load(fileName);
@@ -78,365 +410,6040 @@ SDL_Texture* LoadTexture(const char* fileName) {
     return texture;
 }
 
-std::vector<std::string> splitLine(const std::string& line, TTF_Font* font, int viewportWidth) {
-    std::vector<std::string> lines;
-    std::string currentLine;
-    int currentLineWidth = 0;
-    for (char c : line) {
-        currentLine += c;
-
-        TTF_SizeText(font, currentLine.c_str(), &currentLineWidth, nullptr);
-
-        if (currentLineWidth > viewportWidth) {
-            lines.push_back(currentLine.substr(0, currentLine.length() - 1));
-            currentLine = c;
+// Column reached after the first `length` chars of `text`, tabs expanded to tab stops
+int columnOf(const std::string& text, int length) {
+    int column = 0;
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '\t') {
+            column += TAB_SIZE - column % TAB_SIZE;
+        } else {
+            column++;
         }
     }
-    lines.push_back(currentLine);
-    
-    return lines;
+    return column;
 }
 
-void initRects() {
-    UI = {0, 0, windowWidth, 30};
-    viewport = {0, UI.h, windowWidth, windowHeight - UI.h};
+// `text` with its tabs turned into spaces, as if it started at `column`
+std::string expandTabs(const std::string& text, int column = 0) {
+    std::string expanded;
+    expanded.reserve(text.size());
+    for (char c : text) {
+        if (c == '\t') {
+            expanded.append(TAB_SIZE - (column + expanded.size()) % TAB_SIZE, ' ');
+        } else {
+            expanded += c;
+        }
+    }
+    return expanded;
+}
 
-    scrollBar = {windowWidth - SCROLL_BAR_WIDTH, 0, SCROLL_BAR_WIDTH, 0};
+// Width in pixels of the first `length` chars of `text`
+int textWidth(const std::string& text, int length) {
+    if (monospaceFont) {
+        return columnOf(text, length) * monospaceAdvance;
+    }
 
-    saveButtonBox = {BUTTON_SPAN, BUTTON_SPAN, BUTTON_WIDTH, UI.h-10};
-    loadButtonBox = {BUTTON_SPAN + saveButtonBox.x + saveButtonBox.w, BUTTON_SPAN, BUTTON_WIDTH, UI.h-10};
-    minusButtonBox = {loadButtonBox.x + loadButtonBox.w + BUTTON_SPAN, BUTTON_SPAN, UI.h - 10, UI.h - 10};
-    sizeButtonBox = {minusButtonBox.x + minusButtonBox.w, BUTTON_SPAN, 40, UI.h - 10};
-    plusButtonBox = {sizeButtonBox.x + sizeButtonBox.w, BUTTON_SPAN, UI.h - 10, UI.h - 10};
-    themeButtonBox = {windowWidth - UI.h + 5, BUTTON_SPAN, UI.h - 10, UI.h - 10};
+    int w = 0;
+    TTF_SizeText(font, text.substr(0, length).c_str(), &w, nullptr);
+    return w;
 }
 
-void updateRects() {
-    UI.w = windowWidth;
-    viewport.w = windowWidth;
-
-    scrollBar.x = windowWidth - SCROLL_BAR_WIDTH;
+// Index of the char boundary closest to `x` pixels into `text`
+int charIndexAt(const std::string& text, int x) {
+    int charPos = 0;
 
-    themeButtonBox.x = windowWidth - UI.h + 5;
-}
+    if (monospaceFont) {
+        int column = 0;
+        for (char c : text) {
+            int next = c == '\t' ? column + TAB_SIZE - column % TAB_SIZE : column + 1;
+            if ((column + next) * monospaceAdvance / 2 > x) {
+                break;
+            }
+            column = next;
+            charPos++;
+        }
+        return charPos;
+    }
 
-bool init() {
-    bool success = true;
-    if (SDL_Init(SDL_INIT_EVERYTHING) == 0) {
-        std::cout << "Subsystems initialized!..." << std::endl;
+    int width = 0;
+    for (char c : text) {
+        int charW;
+        TTF_SizeText(font, std::string(1, c).c_str(), &charW, nullptr);
 
-        window = SDL_CreateWindow(
-            "Ogmios", 
-            SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-            WINDOW_WIDTH_DEFAULT, WINDOW_HEIGHT_DEFAULT,
-            SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
-            );
-        if (window) {
-            std::cout << "Window created!" << std::endl;
-        } else {
-            success = false;
+        if (width + charW / 2 > x) {
+            break;
         }
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-        if (renderer) {
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-            std::cout << "Renderer created!" << std::endl;
-        } else {
-            success = false;
+
+        width += charW;
+        charPos++;
+    }
+    return charPos;
+}
+
+// Offsets where `line` wraps when it is laid out `width` pixels wide.
+// Only reads the metric tables, so it is safe to call from the pool.
+std::vector<int> wrapLine(const std::string& line, int width) {
+    std::vector<int> breaks;
+    int x = 0;
+
+    if (monospaceFont) {
+        int maxColumns = std::max(1, width / monospaceAdvance);
+        for (int i = 0; i < static_cast<int>(line.size()); i++) {
+            int next = line[i] == '\t' ? x + TAB_SIZE - x % TAB_SIZE : x + 1;
+            if (next > maxColumns && x > 0) {
+                breaks.push_back(i);
+                next = line[i] == '\t' ? TAB_SIZE : 1;
+            }
+            x = next;
         }
-    } else {
-        success = false;
+        return breaks;
     }
-    if (TTF_Init() == -1) {
-        std::cout << "Error initializing SDL_TTF!" << std::endl;
-        success = false;
+
+    for (int i = 0; i < static_cast<int>(line.size()); i++) {
+        int advance = glyphAdvance[static_cast<unsigned char>(line[i])];
+        if (x + advance > width && x > 0) {
+            breaks.push_back(i);
+            x = 0;
+        }
+        x += advance;
     }
+    return breaks;
+}
 
-    font = TTF_OpenFont("fonts/Nunito-Regular.ttf", DEFAULT_FONT_SIZE);
-    currentFontSize = DEFAULT_FONT_SIZE;
+void updateFontMetrics() {
+    monospaceFont = TTF_FontFaceIsFixedWidth(font) != 0;
 
-    windowWidth = WINDOW_WIDTH_DEFAULT;
-    windowHeight = WINDOW_HEIGHT_DEFAULT;
-    SDL_SetWindowMinimumSize(window, WINDOW_WIDTH_MIN, WINDOW_HEIGHT_MIN);
+    if (monospaceFont) {
+        TTF_GlyphMetrics(font, 'M', nullptr, nullptr, nullptr, nullptr, &monospaceAdvance);
+        monospaceFont = monospaceAdvance > 0;
+    }
 
-    lineHeight = DEFAULT_LINE_HEIGHT;
-    editorLeftMargin = DEFAULT_EDITOR_LEFT_MARGIN;
+    for (int c = 0; c < 256; c++) {
+        glyphAdvance[c] = 0;
+        TTF_GlyphMetrics(font, static_cast<Uint16>(c), nullptr, nullptr, nullptr, nullptr, &glyphAdvance[c]);
+    }
+}
 
-    rCursorX = editorLeftMargin;
-    rCursorY = 0;
 
-    initRects();
-    updateRects();
+#pragma region LAYOUT
+// visualLineStart counts the rows of every line, folded or not: folding a region only touches
+// the spans, and a row is moved past the folds above it by a binary search over them
+int visualLineCount() {
+    return visualLineStart.back() - (foldSpans.empty() ? 0 : foldSpans.back().hidden);
+}
 
-    #pragma region INIT THEMES
-    //  DAY
-    fontColor[DAY] = {65, 34, 52, 255};
-    cursorColor[DAY] = {204, 0, 153, 255};
-    UIColor[DAY] = {50, 26, 40, 255};
-    textBackgroundColor[DAY] = {234, 215, 215, 255};
-    UIBackgroundColor[DAY] = {194, 173, 207, 255};
-    themesIcons[DAY] = LoadTexture("./icons/sun.png");
+int rowCount(int i) {
+    return static_cast<int>(layout[i].breaks.size()) + 1;
+}
 
-    //  NIGHT
-    fontColor[NIGHT] = {255, 255, 255, 255};
-    cursorColor[NIGHT] = {255, 255, 255, 255};
-    UIColor[NIGHT] = {255, 255, 255, 255};
-    textBackgroundColor[NIGHT] = {0, 0, 0, 255};
-    UIBackgroundColor[NIGHT] = {128, 128, 128, 255};
-    themesIcons[NIGHT] = LoadTexture("./icons/moon.png");
+// Last fold span that starts before line `i`, nullptr if none
+const FoldSpan* foldSpanBefore(int i) {
+    auto it = std::lower_bound(foldSpans.begin(), foldSpans.end(), i, [](const FoldSpan& span, int line) { return span.first < line; });
+    return it == foldSpans.begin() ? nullptr : &*(it - 1);
+}
 
-    currentTheme = DAY;
+bool lineHidden(int i) {
+    const FoldSpan* span = foldSpanBefore(i);
+    return span && i <= span->last;
+}
 
-    #pragma endregion
+// Line `i` is drawn as: itself, or the one heading the fold that hides it
+int visibleLineAt(int i) {
+    const FoldSpan* span = foldSpanBefore(i);
+    return span && i <= span->last ? span->first : i;
+}
 
-    SDL_Surface* icon = IMG_Load("icons/Ogmios.png");
-    SDL_SetWindowIcon(window, icon);
+// Line drawn after line `i`, past the fold it heads if any
+int nextVisibleLine(int i) {
+    const FoldSpan* span = foldSpanBefore(i + 1);
+    return span && span->first == i ? span->last + 1 : i + 1;
+}
 
-    SDL_StartTextInput();
+// Visual row line `i` starts on, for a hidden line the row after its fold
+int rowOfLine(int i) {
+    const FoldSpan* span = foldSpanBefore(i);
+    if (!span) {
+        return visualLineStart[i];
+    }
+    return i <= span->last ? span->row : visualLineStart[i] - span->hidden;
+}
 
-    return success;
+// Logical line holding the visual row `row`
+int lineAtVisual(int row) {
+    auto span = std::upper_bound(foldSpans.begin(), foldSpans.end(), row, [](int r, const FoldSpan& s) { return r < s.row; });
+    if (span != foldSpans.begin()) {
+        row += (span - 1)->hidden;
+    }
+    auto it = std::upper_bound(visualLineStart.begin(), visualLineStart.end(), row);
+    int i = static_cast<int>(it - visualLineStart.begin()) - 1;
+    return std::max(0, std::min(i, static_cast<int>(lines.size()) - 1));
 }
 
+int sublineStart(int i, int j) {
+    return j == 0 ? 0 : layout[i].breaks[j - 1];
+}
 
-void updateRenderCursorX() {
-    TTF_SizeText(font, lines[cursorY].substr(0, cursorX).c_str(), &rCursorX, nullptr);
-    rCursorX += editorLeftMargin;
+int sublineEnd(int i, int j) {
+    return j < static_cast<int>(layout[i].breaks.size()) ? layout[i].breaks[j] : static_cast<int>(lines[i].size());
 }
 
-void updateRenderCursorY() {
-    rCursorY = cursorY * lineHeight;
+// Sub-line of line `i` the char boundary `x` is drawn on
+int sublineOf(int i, int x) {
+    const std::vector<int>& breaks = layout[i].breaks;
+    return static_cast<int>(std::upper_bound(breaks.begin(), breaks.end(), x) - breaks.begin());
 }
 
+// Merges `folds` into spans and counts the rows each hides, O(folds) whatever their length
+void indexFolds() {
+    foldSpans.clear();
+    int count = static_cast<int>(visualLineStart.size()) - 1;
+    for (const auto& fold : folds) {
+        int last = std::min(fold.second, count - 1);
+        if (last <= fold.first) {
+            continue;
+        }
+        if (foldSpans.size() && fold.first <= foldSpans.back().last) {
+            foldSpans.back().last = std::max(foldSpans.back().last, last);
+        } else {
+            foldSpans.push_back({fold.first, last, 0, 0});
+        }
+    }
 
-void jumpToLineStart() {
-    cursorX = 0;
-    updateRenderCursorX();
+    int hidden = 0;
+    for (FoldSpan& span : foldSpans) {
+        hidden += visualLineStart[span.last + 1] - visualLineStart[span.first + 1];
+        span.hidden = hidden;
+        span.row = visualLineStart[span.last + 1] - hidden;
+    }
 }
 
-void jumpToLineEnd() {
-    cursorX = static_cast<int>(lines[cursorY].size());
-    updateRenderCursorX();
+void rebuildVisualIndex(int from) {
+    visualLineStart.resize(lines.size() + 1);
+    if (from == 0) {
+        visualLineStart[0] = 0;
+    }
+    for (int i = from; i < static_cast<int>(lines.size()); i++) {
+        visualLineStart[i + 1] = visualLineStart[i] + rowCount(i);
+    }
+    indexFolds();
 }
 
-void jumpToFileStart() {
-    cursorY = 0;
-    jumpToLineStart();
-    updateRenderCursorY();
-}
+// Same as rebuildVisualIndex() but keeps the top line of the view in place.
+// From the line count on it only re-indexes the folds
+void rebuildVisualIndexAnchored(int from) {
+    int top = lineAtVisual(scrollPosition);
+    int offset = scrollPosition - rowOfLine(top);
 
-void jumpToFileEnd() {
-    cursorY = static_cast<int>(lines.size() - 1);
-    jumpToLineEnd();
-    updateRenderCursorY();
-}
+    rebuildVisualIndex(from);
 
+    top = visibleLineAt(top);
+    scrollPosition = rowOfLine(top) + std::min(offset, rowCount(top) - 1);
+}
 
-void scroll(int y) {
-    scrollPosition += y;
-    scrollPosition = std::max(0, std::min(scrollPosition, static_cast<int>(lines.size()-1)));
+bool wrapDirtyLine(int i) {
+    int rows = rowCount(i);
+    layout[i].breaks = wrapLine(lines[i], layoutWidth);
+    layout[i].dirty = false;
+    return rows != rowCount(i);
 }
 
+void ensureLineLayout(int i) {
+    if (layout[i].dirty && wrapDirtyLine(i)) {
+        rebuildVisualIndexAnchored(i);
+    }
+}
 
-void moveCursorUp() {
-    if (cursorY > 0) {
-        cursorY--;
-        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+// Wraps whatever is still dirty on screen, the pool handles the rest
+void layoutVisibleLines() {
+    int visibleRows = viewFrame.h / lineHeight + 2;
+    int changedFrom = -1;
 
-        if ( cursorY  < scrollPosition) {
-            scroll(-1);
+    int top = lineAtVisual(scrollPosition);
+    int rows = rowOfLine(top) - scrollPosition;
+    for (int i = top; i < static_cast<int>(lines.size()) && rows <= visibleRows; i = nextVisibleLine(i)) {
+        if (layout[i].dirty && wrapDirtyLine(i) && changedFrom < 0) {
+            changedFrom = i;
         }
+        rows += rowCount(i);
+    }
 
-        updateRenderCursorY();
-        updateRenderCursorX();
+    if (changedFrom >= 0) {
+        rebuildVisualIndexAnchored(changedFrom);
     }
 }
 
-void moveCursorDown() {
-    if (cursorY < static_cast<int>(lines.size() - 1) ) {
-        cursorY++;
-        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
-        
-        if ( (cursorY+1) * lineHeight > windowHeight - UI.h) {
-            scroll(1);
+void pauseBackgroundWork() {
+    layoutGeneration++;
+    documentMutex.lock();
+}
+
+void resumeBackgroundWork() {
+    documentMutex.unlock();
+}
+
+void submitLayoutWork() {
+    unsigned generation = layoutGeneration;
+    int width = layoutWidth;
+
+    for (int first = 0; first < static_cast<int>(lines.size()); first += LAYOUT_CHUNK_LINES) {
+        int last = std::min(static_cast<int>(lines.size()), first + LAYOUT_CHUNK_LINES);
+
+        bool dirty = false;
+        for (int i = first; i < last && !dirty; i++) {
+            dirty = layout[i].dirty;
+        }
+        if (!dirty) {
+            continue;
         }
-        
-        std::cout << cursorY-1 << " --> " << cursorY << std::endl;
 
-        updateRenderCursorY();
-        updateRenderCursorX();
+        layoutTasksPending++;
+        pool->submit([first, last, generation, width] {
+            LayoutResult result = {first, width, generation, {}};
+            {
+                std::shared_lock<std::shared_mutex> lock(documentMutex);
+                for (int i = first; i < last && layoutGeneration == generation; i++) {
+                    result.breaks.push_back(wrapLine(lines[i], width));
+                }
+            }
+            if (layoutGeneration == generation) {
+                std::lock_guard<std::mutex> lock(layoutResultsMutex);
+                layoutResults.push_back(std::move(result));
+            }
+            layoutTasksPending--;
+        });
     }
+
+    backgroundLayoutPending = true;
 }
 
-void moveCursorLeft() {
-    if (cursorX == 0) {
-        moveCursorUp();
-        cursorX = static_cast<int>(lines[cursorY].size());
-    }
-    else if (cursorX > 0) {
-        cursorX--;
+LayoutCache* findLayoutCache(int width) {
+    for (LayoutCache& cache : layoutCaches) {
+        if (cache.width == width) {
+            return &cache;
+        }
     }
-    updateRenderCursorX();
+    return nullptr;
 }
 
-void moveCursorRight() {
-    if (cursorX == static_cast<int>(lines[cursorY].size())) {
-        moveCursorDown();
-        cursorX = 0;
-        updateRenderCursorX();
+// Folds finished background chunks into the layout of their width, called once per frame
+void applyLayoutResults() {
+    if (!backgroundLayoutPending) {
+        return;
     }
-    else {
-        auto sublines = splitLine(lines[cursorY], font, windowWidth - editorLeftMargin);
-        
-        if (sublines.size()) {
-            int y = rCursorY / lineHeight;
-            int x = 0;
-            for (int i = 0; i <= y-cursorY; i++) {
-                x += static_cast<int>(sublines.size() -1);
-            }
 
-            TTF_SizeText(font, sublines[y - cursorY].substr(0, x).c_str(), &rCursorX, nullptr);
-            rCursorX += editorLeftMargin;
+    std::vector<LayoutResult> results;
+    {
+        std::lock_guard<std::mutex> lock(layoutResultsMutex);
+        results.swap(layoutResults);
+    }
 
-            cursorX++;
+    int changedFrom = -1;
+    for (LayoutResult& result : results) {
+        if (result.generation != layoutGeneration) {
+            continue;
         }
-        else {
-            cursorX++;
-            updateRenderCursorX();
+        LayoutCache* cache = result.width == layoutWidth ? nullptr : findLayoutCache(result.width);
+        if (!cache && result.width != layoutWidth) {
+            continue;
+        }
+        for (int k = 0; k < static_cast<int>(result.breaks.size()); k++) {
+            LineLayout& line = cache ? cache->layout[result.first + k] : layout[result.first + k];
+            if (!line.dirty) {
+                continue;
+            }
+            if (line.breaks.size() != result.breaks[k].size() && cache) {
+                cache->staleFrom = std::min(cache->staleFrom, result.first + k);
+            }
+            else if (line.breaks.size() != result.breaks[k].size() && (changedFrom < 0 || result.first + k < changedFrom)) {
+                changedFrom = result.first + k;
+            }
+            line.breaks = std::move(result.breaks[k]);
+            line.dirty = false;
         }
     }
+
+    if (changedFrom >= 0) {
+        rebuildVisualIndexAnchored(changedFrom);
+    }
+
+    if (layoutTasksPending == 0) {
+        std::lock_guard<std::mutex> lock(layoutResultsMutex);
+        backgroundLayoutPending = !layoutResults.empty();
+    }
 }
 
+// Lines of a view wrap between the line numbers and the minimap
+int wrapWidth(const SDL_Rect& frame) {
+    return frame.w - editorLeftMargin - MINIMAP_WIDTH;
+}
 
-void insertChar(char c) {
-    lines[cursorY].insert(cursorX, 1, c);
-    cursorX++;
-    updateRenderCursorX();
+// The whole document needs wrapping again (new width, new metrics or new content)
+void relayoutDocument() {
+    layoutCaches.clear();
+    layoutWidth = wrapWidth(viewFrame);
+
+    for (LineLayout& line : layout) {
+        line.dirty = true;
+    }
+
+    layoutVisibleLines();
+    submitLayoutWork();
 }
 
-void deletePreviousChar() {
-    if (cursorX > 0) {
-        lines[cursorY].erase(cursorX - 1, 1);
-        cursorX--;
-        updateRenderCursorX();
+void spliceLineLayouts(std::vector<LineLayout>& lineLayouts, int first, int removed, int inserted) {
+    if (removed == inserted) {
+        for (int i = first; i < first + inserted; i++) {
+            lineLayouts[i] = LineLayout();
+        }
+        return;
     }
+    lineLayouts.erase(lineLayouts.begin() + first, lineLayouts.begin() + first + removed);
+    lineLayouts.insert(lineLayouts.begin() + first, inserted, LineLayout());
 }
 
-void deleteNextChar() {
-    if (cursorX < static_cast<int>(lines[cursorY].size())) {
-        lines[cursorY].erase(cursorX, 1);
+// Marks `inserted` lines at `first`, which replaced `removed` old ones, for wrapping at every width
+void spliceLayout(int first, int removed, int inserted) {
+    spliceLineLayouts(layout, first, removed, inserted);
+
+    for (LayoutCache& cache : layoutCaches) {
+        spliceLineLayouts(cache.layout, first, removed, inserted);
+        cache.staleFrom = std::min(cache.staleFrom, first);
+        cache.pending = true;
     }
 }
 
-void insertTab() {
-    lines[cursorY].insert(cursorX, "\t");
-    cursorX++;
-    updateRenderCursorX();
+// Rows from `first` on may have moved; `bulk` edits leave their lines to the pool
+void finishLayoutUpdate(int first, bool bulk) {
+    rebuildVisualIndex(first);
+    scrollPosition = std::min(scrollPosition, visualLineCount() - 1);
+
+    if (bulk || backgroundLayoutPending) {
+        layoutVisibleLines();
+        submitLayoutWork();
+    }
 }
 
-void insertNewLine() {
-    std::string newLine = lines[cursorY].substr(cursorX);
-    lines[cursorY] = lines[cursorY].substr(0, cursorX);
+// Puts the wrap results for `width` in the globals and parks the current ones,
+// a width no view had before starts out dirty and wraps like a resize
+void useLayoutWidth(int width) {
+    if (width == layoutWidth) {
+        return;
+    }
+
+    int count = static_cast<int>(lines.size());
+    LayoutCache parked = {layoutWidth, std::move(layout), std::move(visualLineStart), count, false};
+
+    LayoutCache* cache = findLayoutCache(width);
+    bool pending = true;
+    int staleFrom = 0;
+    if (cache) {
+        layout = std::move(cache->layout);
+        visualLineStart = std::move(cache->visualLineStart);
+        pending = cache->pending;
+        staleFrom = cache->staleFrom;
+        *cache = std::move(parked);
+    } else {
+        layout.assign(count, LineLayout());
+        layoutCaches.push_back(std::move(parked));
+    }
+    layoutWidth = width;
+
+    rebuildVisualIndex(std::min(staleFrom, count));
+    if (pending) {
+        submitLayoutWork();
+    }
+}
+
+// Forgets the widths no view is laid out at anymore
+void dropLayoutCaches(const std::vector<int>& widths) {
+    layoutCaches.erase(std::remove_if(layoutCaches.begin(), layoutCaches.end(), [&widths](const LayoutCache& cache) {
+        return std::find(widths.begin(), widths.end(), cache.width) == widths.end();
+    }), layoutCaches.end());
+}
+#pragma endregion
+
+
+#pragma region VIEWS
+// Every view shows the same `lines`, the focused one gets the keyboard. The view in the globals
+// (cursorX, cursorY, scrollPosition, the selection, extraCarets, viewFrame and the layout for
+// its width) is `currentView`; the others keep their state in `views` and are moved to the
+// globals one at a time to be drawn. Edits only ever happen in the globals, so the other views
+// are told here, and their layouts by spliceLayout().
+void shiftViewLine(int& y, int first, int removed, int inserted) {
+    if (y >= first + removed) {
+        y += inserted - removed;
+    } else if (y >= first + inserted) {
+        y = first + inserted;
+    }
+}
+
+void spliceViews(int first, int removed, int inserted) {
+    for (int k = 0; k < static_cast<int>(views.size()); k++) {
+        if (k == currentView) {
+            continue;
+        }
+        View& view = views[k];
+        shiftViewLine(view.cursorY, first, removed, inserted);
+        shiftViewLine(view.anchorY, first, removed, inserted);
+        shiftViewLine(view.topLine, first, removed, inserted);
+        for (Caret& c : view.extraCarets) {
+            shiftViewLine(c.y, first, removed, inserted);
+            shiftViewLine(c.anchorY, first, removed, inserted);
+        }
+    }
+}
+
+int viewAt(int x, int y) {
+    SDL_Point point = {x, y};
+    for (int k = 0; k < static_cast<int>(views.size()); k++) {
+        if (SDL_PointInRect(&point, &views[k].frame)) {
+            return k;
+        }
+    }
+    return -1;
+}
+#pragma endregion
+
+
+#pragma region MINIMAP
+// Each line is summarised in 64 bits: 16 buckets of 8 columns, each holding how many of them
+// are not blank. The minimap texture has one row per MINIMAP_ROWS_MAX-th of the document, in
+// which every bucket is one texel as opaque as the average of its lines. Edits mark their lines
+// for summarising again and their rows for redrawing; the pool summarises big batches.
+const uint64_t MINIMAP_DIRTY = ~0ULL;    // a nibble never goes past 8
+
+struct MinimapResult {
+    int first;
+    unsigned generation;        // layoutGeneration, bumped by every edit
+    std::vector<uint64_t> summaries;
+};
+
+std::vector<uint64_t> minimapLines;
+int minimapDirtyFrom = 0;       // lines which may be MINIMAP_DIRTY, [from, to)
+int minimapDirtyTo = 0;
+int minimapLinesPerRow = 1;
+int minimapRows = 0;
+int minimapRowsFrom = 0;        // texture rows to redraw, [from, to)
+int minimapRowsTo = 0;
+std::vector<uint32_t> minimapPixels;
+SDL_Texture* minimapTexture = nullptr;
+int minimapTextureRows = 0;
+bool minimapDragging = false;
+
+std::atomic<int> minimapTasksPending(0);
+std::mutex minimapResultsMutex;
+std::vector<MinimapResult> minimapResults;
+
+uint64_t summariseLine(const std::string& line) {
+    uint64_t summary = 0;
+    int column = 0;
+    for (char c : line) {
+        if ((c & 0xC0) == 0x80) {
+            continue;       // UTF-8 continuation byte
+        }
+        if (column >= MINIMAP_BUCKETS * MINIMAP_BUCKET_COLUMNS) {
+            break;
+        }
+        if (c == '\t') {
+            column += TAB_SIZE - column % TAB_SIZE;
+            continue;
+        }
+        if (c != ' ') {
+            summary += 1ULL << (column / MINIMAP_BUCKET_COLUMNS * 4);
+        }
+        column++;
+    }
+    return summary;
+}
+
+void markMinimapRows(int from, int to) {
+    if (minimapRowsFrom >= minimapRowsTo) {
+        minimapRowsFrom = from;
+        minimapRowsTo = to;
+    } else {
+        minimapRowsFrom = std::min(minimapRowsFrom, from);
+        minimapRowsTo = std::max(minimapRowsTo, to);
+    }
+}
+
+void spliceMinimap(int first, int removed, int inserted) {
+    if (removed == inserted) {
+        std::fill(minimapLines.begin() + first, minimapLines.begin() + first + inserted, MINIMAP_DIRTY);
+    } else {
+        minimapLines.erase(minimapLines.begin() + first, minimapLines.begin() + first + removed);
+        minimapLines.insert(minimapLines.begin() + first, inserted, MINIMAP_DIRTY);
+    }
+
+    if (minimapDirtyFrom >= minimapDirtyTo) {
+        minimapDirtyFrom = first;
+        minimapDirtyTo = first + inserted;
+    } else {
+        minimapDirtyFrom = std::min(minimapDirtyFrom, first);
+        minimapDirtyTo = std::max(minimapDirtyTo + inserted - removed, first + inserted);
+    }
+
+    int count = static_cast<int>(minimapLines.size());
+    int perRow = std::max(1, (count + MINIMAP_ROWS_MAX - 1) / MINIMAP_ROWS_MAX);
+    int rows = (count + perRow - 1) / perRow;
+    if (perRow != minimapLinesPerRow || rows != minimapRows) {
+        minimapLinesPerRow = perRow;
+        minimapRows = rows;
+        markMinimapRows(0, rows);
+    } else if (removed != inserted) {
+        markMinimapRows(first / perRow, rows);
+    } else if (inserted > 0) {
+        markMinimapRows(first / perRow, (first + inserted - 1) / perRow + 1);
+    }
+}
+
+void submitMinimapWork(int from, int to) {
+    unsigned generation = layoutGeneration;
+
+    for (int first = from - from % MINIMAP_CHUNK_LINES; first < to; first += MINIMAP_CHUNK_LINES) {
+        int last = std::min(to, first + MINIMAP_CHUNK_LINES);
+        if (std::find(minimapLines.begin() + std::max(first, from), minimapLines.begin() + last, MINIMAP_DIRTY) == minimapLines.begin() + last) {
+            continue;
+        }
+
+        minimapTasksPending++;
+        pool->submit([first, last, generation] {
+            MinimapResult result = {first, generation, {}};
+            {
+                std::shared_lock<std::shared_mutex> lock(documentMutex);
+                for (int i = first; i < last && layoutGeneration == generation; i++) {
+                    result.summaries.push_back(summariseLine(lines[i]));
+                }
+            }
+            // Even cut short: updateMinimap() then knows to look at these lines again
+            {
+                std::lock_guard<std::mutex> lock(minimapResultsMutex);
+                minimapResults.push_back(std::move(result));
+            }
+            minimapTasksPending--;
+        });
+    }
+}
+
+void drawMinimapRow(int row) {
+    int first = row * minimapLinesPerRow;
+    int last = std::min(static_cast<int>(minimapLines.size()), first + minimapLinesPerRow);
+
+    int sums[MINIMAP_BUCKETS] = {};
+    for (int i = first; i < last; i++) {
+        uint64_t summary = minimapLines[i];
+        if (summary == MINIMAP_DIRTY) {
+            continue;
+        }
+        for (int b = 0; b < MINIMAP_BUCKETS; b++) {
+            sums[b] += static_cast<int>((summary >> (b * 4)) & 15);
+        }
+    }
+
+    // Half filled buckets are already fully opaque, code is rarely denser than that
+    uint32_t* texels = &minimapPixels[static_cast<size_t>(row) * MINIMAP_BUCKETS];
+    for (int b = 0; b < MINIMAP_BUCKETS; b++) {
+        uint32_t alpha = std::min(255, sums[b] * 64 / std::max(1, last - first));
+        texels[b] = alpha << 24 | 0xFFFFFF;
+    }
+}
+
+// Summaries from the pool, the small edits and the texture rows they changed, once per frame
+void updateMinimap() {
+    std::vector<MinimapResult> results;
+    {
+        std::lock_guard<std::mutex> lock(minimapResultsMutex);
+        results.swap(minimapResults);
+    }
+    for (MinimapResult& result : results) {
+        if (result.generation != layoutGeneration) {
+            // An edit came in between, whatever this chunk covered is looked at again
+            minimapDirtyFrom = 0;
+            minimapDirtyTo = static_cast<int>(minimapLines.size());
+            continue;
+        }
+        int count = static_cast<int>(result.summaries.size());
+        std::copy(result.summaries.begin(), result.summaries.end(), minimapLines.begin() + result.first);
+        if (count > 0) {
+            markMinimapRows(result.first / minimapLinesPerRow, (result.first + count - 1) / minimapLinesPerRow + 1);
+        }
+    }
+
+    if (minimapDirtyFrom < minimapDirtyTo && minimapTasksPending == 0) {
+        int from = minimapDirtyFrom;
+        int to = std::min(minimapDirtyTo, static_cast<int>(minimapLines.size()));
+        minimapDirtyFrom = minimapDirtyTo = 0;
+        if (to - from > MINIMAP_SYNC_LINES) {
+            submitMinimapWork(from, to);
+        } else {
+            for (int i = from; i < to; i++) {
+                if (minimapLines[i] == MINIMAP_DIRTY) {
+                    minimapLines[i] = summariseLine(lines[i]);
+                }
+            }
+            if (from < to) {
+                markMinimapRows(from / minimapLinesPerRow, (to - 1) / minimapLinesPerRow + 1);
+            }
+        }
+    }
+
+    if (minimapTextureRows != minimapRows && minimapRows > 0) {
+        SDL_DestroyTexture(minimapTexture);
+        minimapTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, MINIMAP_BUCKETS, minimapRows);
+        SDL_SetTextureBlendMode(minimapTexture, SDL_BLENDMODE_BLEND);
+        minimapTextureRows = minimapRows;
+        minimapPixels.assign(static_cast<size_t>(minimapRows) * MINIMAP_BUCKETS, 0);
+        markMinimapRows(0, minimapRows);
+    }
+
+    int from = minimapRowsFrom;
+    int to = std::min(minimapRowsTo, minimapRows);
+    minimapRowsFrom = minimapRowsTo = 0;
+    if (from >= to || !minimapTexture) {
+        return;
+    }
+    for (int row = from; row < to; row++) {
+        drawMinimapRow(row);
+    }
+    SDL_Rect rows = {0, from, MINIMAP_BUCKETS, to - from};
+    SDL_UpdateTexture(minimapTexture, &rows, &minimapPixels[static_cast<size_t>(from) * MINIMAP_BUCKETS], MINIMAP_BUCKETS * sizeof(uint32_t));
+}
+
+// Along the right edge of the current view, as tall as the document up to the view's height
+SDL_Rect minimapBox() {
+    long long height = static_cast<long long>(lines.size()) * MINIMAP_ROW_PIXELS;
+    return {viewFrame.x + viewFrame.w - SCROLL_BAR_WIDTH - MINIMAP_WIDTH, viewFrame.y, MINIMAP_WIDTH, static_cast<int>(std::min<long long>(viewFrame.h, height))};
+}
+
+bool inMinimap(int x, int y) {
+    SDL_Point point = {x, y};
+    SDL_Rect box = minimapBox();
+    return SDL_PointInRect(&point, &box);
+}
+
+// Centers the view on the line at window height `y` of the minimap
+void jumpToMinimap(int y) {
+    SDL_Rect box = minimapBox();
+    int count = static_cast<int>(lines.size());
+    int line = static_cast<int>(static_cast<long long>(std::max(0, y - box.y)) * count / std::max(1, box.h));
+    line = std::max(0, std::min(line, count - 1));
+
+    int visibleRows = std::max(1, viewFrame.h / lineHeight);
+    scrollPosition = std::max(0, std::min(rowOfLine(line) - visibleRows / 2, visualLineCount() - 1));
+    scrollPixels = 0;
+    scrollVelocity = 0;
+}
+
+void renderMinimap() {
+    if (!minimapTexture || lines.empty()) {
+        return;
+    }
+
+    SDL_Rect box = minimapBox();
+    SDL_Color color = fontColor[currentTheme];
+    SDL_SetTextureColorMod(minimapTexture, color.r, color.g, color.b);
+    SDL_RenderCopy(renderer, minimapTexture, nullptr, &box);
+
+    // The lines in view
+    int count = static_cast<int>(lines.size());
+    int top = lineAtVisual(scrollPosition);
+    int bottom = lineAtVisual(scrollPosition + viewFrame.h / lineHeight) + 1;
+    int y0 = box.y + static_cast<int>(static_cast<long long>(top) * box.h / count);
+    int y1 = box.y + static_cast<int>(static_cast<long long>(bottom) * box.h / count);
+    SDL_Rect shown = {box.x, y0, box.w, std::max(2, y1 - y0)};
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, selectionColor[currentTheme].r, selectionColor[currentTheme].g, selectionColor[currentTheme].b, 96);
+    SDL_RenderFillRect(renderer, &shown);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+#pragma endregion
+
+
+#pragma region STATS
+// Chars and words of every line, summed in a Fenwick tree over the lines: retyping a line updates
+// O(log n) nodes, adding or removing lines rebuilds the nodes from the edit on out of the cached
+// per-line counts, and any run of whole lines is two prefix queries. Chars are code points, words
+// runs of anything but blanks; the document's newlines count as chars.
+struct TextStats {
+    long long chars = 0;
+    long long words = 0;
+
+    TextStats& operator+=(const TextStats& other) {
+        chars += other.chars;
+        words += other.words;
+        return *this;
+    }
+
+    TextStats& operator-=(const TextStats& other) {
+        chars -= other.chars;
+        words -= other.words;
+        return *this;
+    }
+};
+
+// Half the size of TextStats, a line is shorter than 2 GB
+struct LineStats {
+    int chars = 0;
+    int words = 0;
+
+    TextStats total() const {
+        TextStats stats;
+        stats.chars = chars;
+        stats.words = words;
+        return stats;
+    }
+};
+
+std::vector<LineStats> lineStats;
+std::vector<TextStats> statsTree;   // 1-based, node i sums the lines [i - (i & -i), i)
+
+TextStats countText(const char* text, size_t length) {
+    TextStats stats;
+    bool inWord = false;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        stats.chars += (c & 0xC0) != 0x80;
+        bool blank = c == ' ' || c == '\t' || c == '\r';
+        stats.words += !blank && !inWord;
+        inWord = !blank;
+    }
+    return stats;
+}
+
+// The first `count` lines
+TextStats statsPrefix(int count) {
+    TextStats sum;
+    for (int i = count; i > 0; i -= i & -i) {
+        sum += statsTree[i];
+    }
+    return sum;
+}
+
+LineStats countLine(const std::string& line) {
+    TextStats stats = countText(line.data(), line.size());
+    return {static_cast<int>(stats.chars), static_cast<int>(stats.words)};
+}
+
+void addLineStats(int line, const TextStats& delta) {
+    for (int i = line + 1; i < static_cast<int>(statsTree.size()); i += i & -i) {
+        statsTree[i] += delta;
+    }
+}
+
+// Nodes up to `first` only cover lines before it; the others are their line plus their children
+void rebuildStatsTree(int first) {
+    int count = static_cast<int>(lineStats.size());
+    statsTree.resize(count + 1);
+    for (int i = first + 1; i <= count; i++) {
+        TextStats sum = lineStats[i - 1].total();
+        for (int child = i - 1; child > i - (i & -i); child -= child & -child) {
+            sum += statsTree[child];
+        }
+        statsTree[i] = sum;
+    }
+}
+
+void spliceStats(int first, int removed, int inserted) {
+    if (removed == inserted) {
+        for (int i = first; i < first + inserted; i++) {
+            LineStats stats = countLine(lines[i]);
+            TextStats delta = stats.total();
+            delta -= lineStats[i].total();
+            lineStats[i] = stats;
+            addLineStats(i, delta);
+        }
+        return;
+    }
+
+    lineStats.erase(lineStats.begin() + first, lineStats.begin() + first + removed);
+    lineStats.insert(lineStats.begin() + first, inserted, LineStats());
+    for (int i = first; i < first + inserted; i++) {
+        lineStats[i] = countLine(lines[i]);
+    }
+    rebuildStatsTree(first);
+}
+
+TextStats documentStats() {
+    TextStats stats = statsPrefix(static_cast<int>(lineStats.size()));
+    stats.chars += static_cast<long long>(lineStats.size()) - 1;
+    return stats;
+}
+
+// [start, end) between two document positions: the two end lines are counted, the ones between
+// come from the tree. A word cut by either end counts once
+TextStats rangeStats(int startX, int startY, int endX, int endY) {
+    if (startY == endY) {
+        return countText(lines[startY].data() + startX, endX - startX);
+    }
+
+    TextStats stats = countText(lines[startY].data() + startX, lines[startY].size() - startX);
+    stats += statsPrefix(endY);
+    stats -= statsPrefix(startY + 1);
+    stats += countText(lines[endY].data(), endX);
+    stats.chars += endY - startY;
+    return stats;
+}
+#pragma endregion
+
+
+#pragma region BRACKETS
+// Matching (), [] and {} through a segment tree over the lines. A node keeps, for each kind, the
+// net depth its lines add and the lowest depth reached inside them, relative to where they start.
+// The partner of an opening bracket is in the first line after it where the depth dips below the
+// one the bracket opened, of a closing bracket in the last line before it where the depth was
+// lower than before it: both are a walk up and down the tree, then a scan of that one line.
+// Brackets in strings and comments count like any other.
+const int BRACKET_KINDS = 3;
+const char* const BRACKET_OPENERS = "([{";
+const char* const BRACKET_CLOSERS = ")]}";
+
+struct BracketSummary {
+    int delta[BRACKET_KINDS] = {};
+    int low[BRACKET_KINDS] = {};    // never above 0, the depth the lines start at
+};
+
+std::vector<BracketSummary> bracketTree;    // node p covers nodes 2p and 2p + 1, line i is leaf bracketLeaves + i
+int bracketLeaves = 0;
+int bracketLineCount = 0;
+
+// The kind of bracket `c` is, -1 if it is none; `opening` tells which side
+int bracketKind(char c, bool& opening) {
+    for (int kind = 0; kind < BRACKET_KINDS; kind++) {
+        if (c == BRACKET_OPENERS[kind] || c == BRACKET_CLOSERS[kind]) {
+            opening = c == BRACKET_OPENERS[kind];
+            return kind;
+        }
+    }
+    return -1;
+}
+
+BracketSummary summariseBrackets(const std::string& line) {
+    BracketSummary summary;
+    for (char c : line) {
+        bool opening;
+        int kind = bracketKind(c, opening);
+        if (kind < 0) {
+            continue;
+        }
+        summary.delta[kind] += opening ? 1 : -1;
+        summary.low[kind] = std::min(summary.low[kind], summary.delta[kind]);
+    }
+    return summary;
+}
+
+BracketSummary combineBrackets(const BracketSummary& a, const BracketSummary& b) {
+    BracketSummary sum;
+    for (int kind = 0; kind < BRACKET_KINDS; kind++) {
+        sum.delta[kind] = a.delta[kind] + b.delta[kind];
+        sum.low[kind] = std::min(a.low[kind], a.delta[kind] + b.low[kind]);
+    }
+    return sum;
+}
+
+// The leaves are the lines themselves, an edit shifts those after it and refreshes every node above
+void spliceBrackets(int first, int removed, int inserted) {
+    int oldCount = bracketLineCount;
+    bracketLineCount += inserted - removed;
+    int from = first;    // the nodes to refresh are above leaves from..last
+    int last = removed == inserted ? first + inserted - 1 : std::max(oldCount, bracketLineCount) - 1;
+
+    if (bracketLineCount > bracketLeaves) {
+        int leaves = std::max(1, bracketLeaves);
+        while (leaves < bracketLineCount) {
+            leaves *= 2;
+        }
+        std::vector<BracketSummary> tree(2 * leaves);
+        std::copy(bracketTree.begin() + bracketLeaves, bracketTree.begin() + bracketLeaves + first, tree.begin() + leaves);
+        std::copy(bracketTree.begin() + bracketLeaves + first + removed, bracketTree.begin() + bracketLeaves + oldCount, tree.begin() + leaves + first + inserted);
+        bracketTree.swap(tree);
+        bracketLeaves = leaves;
+        from = 0;
+        last = bracketLineCount - 1;
+    } else if (removed != inserted) {
+        auto leaf = bracketTree.begin() + bracketLeaves;
+        if (inserted < removed) {
+            std::copy(leaf + first + removed, leaf + oldCount, leaf + first + inserted);
+            std::fill(leaf + bracketLineCount, leaf + oldCount, BracketSummary());
+        } else {
+            std::copy_backward(leaf + first + removed, leaf + oldCount, leaf + bracketLineCount);
+        }
+    }
+
+    for (int i = first; i < first + inserted; i++) {
+        bracketTree[bracketLeaves + i] = summariseBrackets(lines[i]);
+    }
+
+    if (last < from) {
+        return;
+    }
+    for (int lo = (bracketLeaves + from) / 2, hi = (bracketLeaves + last) / 2; lo >= 1; lo /= 2, hi /= 2) {
+        for (int p = lo; p <= hi; p++) {
+            bracketTree[p] = combineBrackets(bracketTree[2 * p], bracketTree[2 * p + 1]);
+        }
+    }
+}
+
+// Depth of `kind` where line `line` starts
+int bracketDepthBefore(int kind, int line) {
+    int depth = 0;
+    for (int l = bracketLeaves, r = bracketLeaves + line; l < r; l /= 2, r /= 2) {
+        if (l & 1) {
+            depth += bracketTree[l++].delta[kind];
+        }
+        if (r & 1) {
+            depth += bracketTree[--r].delta[kind];
+        }
+    }
+    return depth;
+}
+
+// First line from `from` on in which the depth of `kind` goes below `target`, -1 if none
+int findBracketDipAfter(int kind, int from, int target) {
+    if (from >= bracketLineCount) {
+        return -1;
+    }
+
+    int depth = bracketDepthBefore(kind, from);
+    int p = bracketLeaves + from;
+    while (depth + bracketTree[p].low[kind] >= target) {
+        depth += bracketTree[p].delta[kind];
+        while (p > 1 && (p & 1)) {
+            p /= 2;
+        }
+        if (p == 1) {
+            return -1;
+        }
+        p++;
+    }
+    while (p < bracketLeaves) {
+        if (depth + bracketTree[2 * p].low[kind] < target) {
+            p = 2 * p;
+        } else {
+            depth += bracketTree[2 * p].delta[kind];
+            p = 2 * p + 1;
+        }
+    }
+    return p - bracketLeaves < bracketLineCount ? p - bracketLeaves : -1;
+}
+
+// Last line up to `to` in which the depth of `kind` is ever below `target`, -1 if none
+int findBracketDipBefore(int kind, int to, int target) {
+    if (to < 0) {
+        return -1;
+    }
+
+    int depth = bracketDepthBefore(kind, to + 1);    // where the node at p ends
+    int p = bracketLeaves + to;
+    while (depth - bracketTree[p].delta[kind] + bracketTree[p].low[kind] >= target) {
+        depth -= bracketTree[p].delta[kind];
+        while (p > 1 && !(p & 1)) {
+            p /= 2;
+        }
+        if (p == 1) {
+            return -1;
+        }
+        p--;
+    }
+    while (p < bracketLeaves) {
+        const BracketSummary& right = bracketTree[2 * p + 1];
+        if (depth - right.delta[kind] + right.low[kind] < target) {
+            p = 2 * p + 1;
+        } else {
+            depth -= right.delta[kind];
+            p = 2 * p;
+        }
+    }
+    return p - bracketLeaves;
+}
+
+// Partner of the bracket at (x, y), false when there is no bracket there or it is unmatched
+bool findMatchingBracket(int x, int y, int& matchX, int& matchY) {
+    const std::string& line = lines[y];
+    bool opening;
+    int kind = x < static_cast<int>(line.size()) ? bracketKind(line[x], opening) : -1;
+    if (kind < 0) {
+        return false;
+    }
+
+    // The depth before the bracket
+    int base = bracketDepthBefore(kind, y);
+    for (int k = 0; k < x; k++) {
+        bool open;
+        if (bracketKind(line[k], open) == kind) {
+            base += open ? 1 : -1;
+        }
+    }
+
+    if (opening) {
+        int depth = base + 1;
+        int j = y;
+        int k = x + 1;
+        for (;;) {
+            for (; k < static_cast<int>(lines[j].size()); k++) {
+                bool open;
+                if (bracketKind(lines[j][k], open) == kind) {
+                    depth += open ? 1 : -1;
+                    if (depth == base) {
+                        matchX = k;
+                        matchY = j;
+                        return true;
+                    }
+                }
+            }
+            if (j != y) {
+                return false;
+            }
+            j = findBracketDipAfter(kind, y + 1, base + 1);
+            if (j < 0) {
+                return false;
+            }
+            depth = bracketDepthBefore(kind, j);
+            k = 0;
+        }
+    }
+
+    // Walking back, `depth` is the depth after char k
+    int depth = base;
+    int j = y;
+    int k = x - 1;
+    for (;;) {
+        for (; k >= 0; k--) {
+            bool open;
+            if (bracketKind(lines[j][k], open) == kind) {
+                if (open && depth == base) {
+                    matchX = k;
+                    matchY = j;
+                    return true;
+                }
+                depth += open ? -1 : 1;
+            }
+        }
+        if (j != y) {
+            return false;
+        }
+        j = findBracketDipBefore(kind, y - 1, base);
+        if (j < 0) {
+            return false;
+        }
+        depth = bracketDepthBefore(kind, j + 1);
+        k = static_cast<int>(lines[j].size()) - 1;
+    }
+}
+
+// The bracket the cursor is on or just after, and its partner
+bool cursorBracketPair(int& x, int& y, int& matchX, int& matchY) {
+    y = cursorY;
+    for (x = cursorX; x >= std::max(0, cursorX - 1); x--) {
+        if (findMatchingBracket(x, y, matchX, matchY)) {
+            return true;
+        }
+    }
+    return false;
+}
+#pragma endregion
+
+
+#pragma region FOLDS
+// A fold lives in `folds` until an edit reaches past its first line, the spans and rows the
+// layout shows are derived from it, see LAYOUT. Typing in the first line, splitting it with Enter
+// or joining it to the line above (how Enter is undone) moves the fold along with the lines below.
+void spliceFolds(int first, int removed, int inserted) {
+    if (folds.empty()) {
+        return;
+    }
+
+    int shift = inserted - removed;
+    std::vector<std::pair<int, int>> kept;
+    kept.reserve(folds.size());
+    for (const auto& fold : folds) {
+        bool header = (first == fold.first && removed == 1 && inserted > 0) ||
+                      (first + 1 == fold.first && removed == 2 && inserted == 1);
+        if (first + removed <= fold.first || header) {
+            kept.emplace_back(fold.first + shift, fold.second + shift);
+        } else if (first > fold.second) {
+            kept.push_back(fold);
+        }
+    }
+    folds.clear();
+    folds.insert(kept.begin(), kept.end());
+}
+
+int indentWidth(const std::string& line) {
+    int width = 0;
+    for (char c : line) {
+        if (c == ' ') {
+            width++;
+        } else if (c == '\t') {
+            width += TAB_SIZE - width % TAB_SIZE;
+        } else {
+            return width;
+        }
+    }
+    return -1;    // blank
+}
+
+// Last line of the region line `y` opens: the one before the partner of its last bracket closed
+// further down, found through the bracket tree, else the last one indented deeper below it
+bool foldRegionAt(int y, int& last) {
+    const std::string& line = lines[y];
+    for (int x = static_cast<int>(line.size()) - 1; x >= 0; x--) {
+        bool opening;
+        int matchX, matchY;
+        if (bracketKind(line[x], opening) >= 0 && opening && findMatchingBracket(x, y, matchX, matchY) && matchY > y) {
+            last = matchY - 1;
+            return last > y;
+        }
+    }
+
+    int indent = indentWidth(line);
+    if (indent < 0) {
+        return false;
+    }
+    last = y;
+    for (int i = y + 1; i < static_cast<int>(lines.size()); i++) {
+        int width = indentWidth(lines[i]);
+        if (width >= 0 && width <= indent) {
+            break;
+        }
+        if (width >= 0) {
+            last = i;
+        }
+    }
+    return last > y;
+}
+
+// Unfolds whatever hides line `y`, true if anything did
+bool revealLine(int y) {
+    if (!lineHidden(y)) {
+        return false;
+    }
+    for (auto it = folds.begin(); it != folds.end() && it->first < y;) {
+        it = it->second >= y ? folds.erase(it) : std::next(it);
+    }
+    rebuildVisualIndexAnchored(static_cast<int>(lines.size()));
+    return true;
+}
+#pragma endregion
+
+
+#pragma region SYNTAX
+// A lexer reads one line starting in the state the previous line ended in,
+// appends its coloured spans and returns the state the line ends in.
+// Each line caches its end state, so an edit only re-lexes lines until
+// the end state of an untouched line comes out unchanged.
+struct Lexer {
+    const char* extensions;     // space separated, with the dots
+    int (*lexLine)(const std::string& line, int state, std::vector<Span>& spans);
+};
+
+struct LineHighlight {
+    std::vector<Span> spans;
+    int endState = 0;
+    bool dirty = false;
+};
+
+bool isWordChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isKeyword(const std::string& line, int start, int length, const char* const* keywords) {
+    for (const char* const* k = keywords; *k; k++) {
+        if (static_cast<int>(strlen(*k)) == length && line.compare(start, length, *k) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void pushSpan(std::vector<Span>& spans, int start, int length, int token) {
+    if (spans.size() && spans.back().token == token && spans.back().start + spans.back().length == start) {
+        spans.back().length += length;
+    } else {
+        spans.push_back({start, length, token});
+    }
+}
+
+// Words, numbers and quoted strings, shared by the lexers below
+int lexToken(const std::string& line, int i, const char* const* keywords, std::vector<Span>& spans) {
+    int n = static_cast<int>(line.size());
+    char c = line[i];
+
+    if (c == '"' || c == '\'') {
+        int j = i + 1;
+        while (j < n && line[j] != c) {
+            j += line[j] == '\\' ? 2 : 1;
+        }
+        j = std::min(n, j + 1);
+        pushSpan(spans, i, j - i, TOKEN_STRING);
+        return j;
+    }
+    if (isdigit(static_cast<unsigned char>(c))) {
+        int j = i;
+        while (j < n && (isWordChar(line[j]) || line[j] == '.')) {
+            j++;
+        }
+        pushSpan(spans, i, j - i, TOKEN_NUMBER);
+        return j;
+    }
+    if (isWordChar(c)) {
+        int j = i;
+        while (j < n && isWordChar(line[j])) {
+            j++;
+        }
+        if (isKeyword(line, i, j - i, keywords)) {
+            pushSpan(spans, i, j - i, TOKEN_KEYWORD);
+        }
+        return j;
+    }
+    return i + 1;
+}
+
+int lexPlainLine(const std::string&, int, std::vector<Span>&) {
+    return 0;
+}
+
+// C, C++, Java, JavaScript, Rust, Go... State 1 is "inside a block comment".
+int lexCLine(const std::string& line, int state, std::vector<Span>& spans) {
+    static const char* const keywords[] = {
+        "auto", "bool", "break", "case", "catch", "char", "class", "const", "continue", "default",
+        "delete", "do", "double", "else", "enum", "export", "extern", "false", "float", "fn", "for",
+        "func", "function", "if", "impl", "import", "int", "let", "long", "match", "mut", "namespace",
+        "new", "null", "nullptr", "package", "private", "protected", "public", "return", "short",
+        "signed", "sizeof", "static", "struct", "switch", "template", "this", "throw", "true", "try",
+        "typedef", "typename", "unsigned", "use", "using", "var", "virtual", "void", "volatile", "while",
+        nullptr
+    };
+
+    int n = static_cast<int>(line.size());
+    int i = 0;
+
+    while (i < n) {
+        if (state == 1) {
+            size_t end = line.find("*/", i);
+            int j = end == std::string::npos ? n : static_cast<int>(end) + 2;
+            pushSpan(spans, i, j - i, TOKEN_COMMENT);
+            state = end == std::string::npos ? 1 : 0;
+            i = j;
+        }
+        else if (line.compare(i, 2, "//") == 0) {
+            pushSpan(spans, i, n - i, TOKEN_COMMENT);
+            i = n;
+        }
+        else if (line.compare(i, 2, "/*") == 0) {
+            pushSpan(spans, i, 2, TOKEN_COMMENT);
+            state = 1;
+            i += 2;
+        }
+        else if (line[i] == '#' && line.find_first_not_of(" \t") == static_cast<size_t>(i)) {
+            int j = i + 1;
+            while (j < n && isWordChar(line[j])) {
+                j++;
+            }
+            pushSpan(spans, i, j - i, TOKEN_KEYWORD);
+            i = j;
+        }
+        else {
+            i = lexToken(line, i, keywords, spans);
+        }
+    }
+    return state;
+}
+
+// Python, shell, Ruby, YAML, CMake... # starts a comment
+int lexScriptLine(const std::string& line, int, std::vector<Span>& spans) {
+    static const char* const keywords[] = {
+        "and", "as", "case", "class", "def", "do", "done", "elif", "else", "end", "esac", "except",
+        "export", "False", "fi", "finally", "for", "from", "function", "if", "import", "in", "lambda",
+        "local", "None", "not", "or", "pass", "raise", "return", "then", "True", "try", "while",
+        "with", "yield", nullptr
+    };
+
+    int n = static_cast<int>(line.size());
+    for (int i = 0; i < n; ) {
+        if (line[i] == '#') {
+            pushSpan(spans, i, n - i, TOKEN_COMMENT);
+            break;
+        }
+        i = lexToken(line, i, keywords, spans);
+    }
+    return 0;
+}
+
+const Lexer lexers[] = {
+    {".c .h .cpp .hpp .cc .cxx .hxx .java .js .ts .cs .rs .go .swift .kt", lexCLine},
+    {".py .sh .bash .rb .pl .yml .yaml .toml .cmake .mk .conf", lexScriptLine},
+};
+const Lexer plainLexer = {"", lexPlainLine};
+
+const Lexer* currentLexer = &plainLexer;
+
+std::vector<LineHighlight> highlights;
+int highlightValidUpTo = 0;     // lines before it are lexed and their end states chain up
+int dirtyHighlights = 0;
+int relexFrom = -1;
+
+void setLexerFor(const std::string& path) {
+    currentLexer = &plainLexer;
+
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        std::string extension = path.substr(dot) + " ";
+        for (const Lexer& lexer : lexers) {
+            if ((std::string(lexer.extensions) + " ").find(extension) != std::string::npos) {
+                currentLexer = &lexer;
+            }
+        }
+    }
+
+    highlights.assign(lines.size(), LineHighlight());
+    highlightValidUpTo = 0;
+    dirtyHighlights = 0;
+    relexFrom = -1;
+}
+
+int lexLine(int i) {
+    LineHighlight& highlight = highlights[i];
+    int oldState = highlight.endState;
+
+    highlight.spans.clear();
+    highlight.endState = currentLexer->lexLine(lines[i], i > 0 ? highlights[i - 1].endState : 0, highlight.spans);
+    if (highlight.dirty) {
+        highlight.dirty = false;
+        dirtyHighlights--;
+    }
+    return oldState;
+}
+
+// `inserted` lines at `first` replaced `removed` old ones; only lexed lines need care
+void spliceHighlights(int first, int removed, int inserted) {
+    if (first >= highlightValidUpTo) {
+        highlights.erase(highlights.begin() + first, highlights.begin() + first + removed);
+        highlights.insert(highlights.begin() + first, inserted, LineHighlight());
+        return;
+    }
+
+    for (int i = first; i < first + removed; i++) {
+        dirtyHighlights -= highlights[i].dirty;
+    }
+    if (removed == inserted) {
+        for (int i = first; i < first + inserted; i++) {
+            highlights[i].spans.clear();
+        }
+    } else {
+        highlights.erase(highlights.begin() + first, highlights.begin() + first + removed);
+        highlights.insert(highlights.begin() + first, inserted, LineHighlight());
+    }
+    for (int i = first; i < first + inserted; i++) {
+        highlights[i].dirty = true;
+    }
+    dirtyHighlights += inserted;
+
+    highlightValidUpTo = first + removed <= highlightValidUpTo ? highlightValidUpTo - removed + inserted : first + inserted;
+    relexFrom = relexFrom < 0 ? first : std::min(relexFrom, first);
+}
+
+// Re-lexes from the first edited line until every edited line is done and the states converge
+void relexEditedLines() {
+    if (relexFrom < 0) {
+        return;
+    }
+
+    for (int i = relexFrom; i < highlightValidUpTo; i++) {
+        bool edited = highlights[i].dirty;
+        int oldState = lexLine(i);
+        if (!edited && dirtyHighlights == 0 && oldState == highlights[i].endState) {
+            break;
+        }
+    }
+    relexFrom = -1;
+}
+
+// Lexes on until line `last` is ready, or until `budget` lines were lexed
+void lexUpTo(int last, int budget) {
+    last = std::min(last, static_cast<int>(lines.size()) - 1);
+    for (; highlightValidUpTo <= last && budget > 0; budget--) {
+        lexLine(highlightValidUpTo++);
+    }
+}
+#pragma endregion
+
+
+#pragma region JOURNAL
+// Every edit since the last load or save is appended to JOURNAL_PATH so a crash loses nothing.
+// A record is [u32 size][payload][u32 FNV-1a of payload]; the payload is either
+//   JOURNAL_BASE:   u64 file size, then the path the document was loaded from or saved to ("" when new)
+//   JOURNAL_SPLICE: u32 first, u32 removed, u32 inserted, then each inserted line as u32 length + bytes
+// The keystroke path only encodes the record into a buffer, a writer thread does the I/O
+// and group-commits whatever piled up meanwhile with a single fdatasync().
+enum journalRecords { JOURNAL_BASE = 1, JOURNAL_SPLICE = 2 };
+
+std::thread journalThread;
+std::mutex journalMutex;
+std::condition_variable journalWakeUp;
+std::string journalPending;
+bool journalTruncate = false;
+bool journalStopping = false;
+bool journalRunning = false;
+int journalFile = -1;
+
+std::string documentPath;
+bool documentFinalNewline = true;   // the file ends with a line break, a save writes it back the same way
+bool documentEdited = false;        // changed since the file was last read or written, see journalReset()
+int documentLineDelta = 0;          // lines the edits since then added, the file has that many fewer
+
+void putU32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+uint32_t getU32(const char* in) {
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+uint32_t fnv1a(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Reads `in` line by line, `finalNewline` tells whether the last line had a line break
+void readLines(std::istream& in, std::vector<std::string>& document, bool& finalNewline) {
+    document.clear();
+    finalNewline = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        finalNewline = !in.eof();
+        document.push_back(std::move(line));
+    }
+
+    if (document.empty()) {
+        document.push_back("");
+    }
+}
+
+bool readDocument(const std::string& path, std::vector<std::string>& document, bool& finalNewline) {
+    std::ifstream in(path);
+    readLines(in, document, finalNewline);
+    return !in.bad() && in.eof();
+}
+
+bool fileEndsWithNewline(const std::string& path) {
+    struct stat info;
+    char last = 0;
+    int file = open(path.c_str(), O_RDONLY);
+    if (file >= 0 && fstat(file, &info) == 0 && info.st_size > 0 && pread(file, &last, 1, info.st_size - 1) != 1) {
+        last = 0;
+    }
+    if (file >= 0) {
+        close(file);
+    }
+    return last == '\n';
+}
+
+// Applies one journal record to `document`, false when it cannot be trusted.
+// A base record also sets `finalNewline` to whether the file ends with a line break.
+bool replayJournalRecord(const char* payload, uint32_t size, std::vector<std::string>& document, std::string& path, bool& finalNewline) {
+    if (payload[0] == JOURNAL_BASE && size >= 9) {
+        uint64_t fileSize;
+        memcpy(&fileSize, payload + 1, sizeof(fileSize));
+        path.assign(payload + 9, size - 9);
+        if (path.empty()) {
+            document.assign(1, "");
+            finalNewline = true;
+            return true;
+        }
+
+        // The journal only holds edits, the file they apply to must not have changed since
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && static_cast<uint64_t>(info.st_size) == fileSize && readDocument(path, document, finalNewline);
+    }
+
+    if (payload[0] != JOURNAL_SPLICE || size < 13 || document.empty()) {
+        return false;
+    }
+
+    uint32_t first = getU32(payload + 1);
+    uint32_t removed = getU32(payload + 5);
+    uint32_t inserted = getU32(payload + 9);
+    if (first + static_cast<uint64_t>(removed) > document.size()) {
+        return false;
+    }
+
+    std::vector<std::string> text;
+    size_t offset = 13;
+    for (uint32_t n = 0; n < inserted; n++) {
+        if (offset + 4 > size || offset + 4 + getU32(payload + offset) > size) {
+            return false;
+        }
+        uint32_t length = getU32(payload + offset);
+        text.emplace_back(payload + offset + 4, length);
+        offset += 4 + length;
+    }
+
+    document.erase(document.begin() + first, document.begin() + first + removed);
+    document.insert(document.begin() + first, std::make_move_iterator(text.begin()), std::make_move_iterator(text.end()));
+    return !document.empty();
+}
+
+// Replays the framed records of `journal` into `document`, returns how many bytes of it were valid.
+// `edited` tells whether the document differs from its base file afterwards.
+size_t replayJournal(const char* journal, size_t length, bool fromStart, std::vector<std::string>& document, std::string& path,
+                     bool& finalNewline, bool& edited) {
+    size_t offset = 0;
+    while (offset + 8 <= length) {
+        uint32_t size = getU32(journal + offset);
+        if (size == 0 || size > length - offset - 8) {
+            break;
+        }
+        const char* payload = journal + offset + 4;
+        if (fnv1a(payload, size) != getU32(payload + size) ||
+            (fromStart && offset == 0 && payload[0] != JOURNAL_BASE) ||
+            !replayJournalRecord(payload, size, document, path, finalNewline)
+        ) {
+            break;
+        }
+        edited = payload[0] == JOURNAL_SPLICE;
+        offset += size + 8;
+    }
+    return offset;
+}
+
+std::string autosavePath(const std::string& path) {
+    return path.empty() ? AUTOSAVE_UNTITLED_PATH : path + ".autosave";
+}
+
+// Writes through a temporary file so a crash mid-write never leaves a truncated autosave
+void writeAutosave(const std::vector<std::string>& document, const std::string& path, bool finalNewline) {
+    std::string target = autosavePath(path);
+    std::string temporary = target + ".tmp";
+
+    std::ofstream out(temporary);
+    for (size_t i = 0; i < document.size(); i++) {
+        out << document[i];
+        if (i + 1 < document.size() || finalNewline) {
+            out << '\n';
+        }
+    }
+    out.close();
+
+    if (!out || rename(temporary.c_str(), target.c_str()) != 0) {
+        std::cout << "Autosave failed: " << target << std::endl;
+    }
+}
+
+// Frames `payload` and queues it for the writer
+void journalAppend(const std::string& payload, bool truncate) {
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        if (truncate) {
+            journalPending.clear();
+            journalTruncate = true;
+        }
+        journalPending.reserve(journalPending.size() + payload.size() + 8);
+        putU32(journalPending, static_cast<uint32_t>(payload.size()));
+        journalPending += payload;
+        putU32(journalPending, fnv1a(payload.data(), payload.size()));
+    }
+    journalWakeUp.notify_one();
+}
+
+// Lines [first, first + inserted) replaced `removed` lines
+void journalSplice(int first, int removed, int inserted) {
+    documentEdited = true;
+    documentLineDelta += inserted - removed;
+    if (!journalRunning) {
+        return;
+    }
+
+    std::string payload(1, static_cast<char>(JOURNAL_SPLICE));
+    putU32(payload, first);
+    putU32(payload, removed);
+    putU32(payload, inserted);
+    for (int i = first; i < first + inserted; i++) {
+        putU32(payload, static_cast<uint32_t>(lines[i].size()));
+        payload += lines[i];
+    }
+    journalAppend(payload, false);
+}
+
+// The document now matches the file at `path` (or is empty): older records are obsolete
+void journalReset(const std::string& path) {
+    documentEdited = false;
+    documentLineDelta = 0;
+    if (!journalRunning) {
+        return;
+    }
+
+    struct stat info;
+    uint64_t size = path.size() && stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+
+    std::string payload(1, static_cast<char>(JOURNAL_BASE));
+    payload.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    payload += path;
+    journalAppend(payload, true);
+}
+
+// Besides writing the journal, the writer replays each batch into its own replica of the document.
+// The replica is the autosave snapshot: it is serialised here every AUTOSAVE_INTERVAL_SECONDS
+// while editing goes on, without the main thread ever copying `lines` for it.
+void journalWriter(off_t recovered) {
+    std::vector<std::string> replica;
+    std::string replicaPath;
+    bool replicaFinalNewline = true;
+    bool replicaValid = false;
+    bool replicaEdited = false;
+
+    if (recovered > 0) {
+        std::ifstream in(JOURNAL_PATH, std::ios::binary);
+        std::string journal(recovered, '\0');
+        in.read(&journal[0], recovered);
+        replicaValid = replayJournal(journal.data(), journal.size(), true, replica, replicaPath, replicaFinalNewline, replicaEdited) == journal.size();
+    }
+
+    auto nextAutosave = std::chrono::steady_clock::now() + std::chrono::seconds(AUTOSAVE_INTERVAL_SECONDS);
+    std::string batch;
+    while (true) {
+        bool truncate;
+        {
+            std::unique_lock<std::mutex> lock(journalMutex);
+            journalWakeUp.wait_until(lock, nextAutosave, [] { return journalStopping || journalPending.size(); });
+            if (journalStopping && journalPending.empty()) {
+                return;
+            }
+            batch.swap(journalPending);
+            truncate = journalTruncate;
+            journalTruncate = false;
+        }
+
+        if (std::chrono::steady_clock::now() >= nextAutosave) {
+            if (replicaValid && replicaEdited) {
+                writeAutosave(replica, replicaPath, replicaFinalNewline);
+            }
+            nextAutosave = std::chrono::steady_clock::now() + std::chrono::seconds(AUTOSAVE_INTERVAL_SECONDS);
+        }
+
+        if (batch.empty()) {
+            continue;
+        }
+
+        if (truncate && ftruncate(journalFile, 0) != 0) {
+            std::cout << "Journal truncate error: " << strerror(errno) << std::endl;
+        }
+        for (size_t written = 0; written < batch.size(); ) {
+            ssize_t n = write(journalFile, batch.data() + written, batch.size() - written);
+            if (n < 0 && errno != EINTR) {
+                std::cout << "Journal write error: " << strerror(errno) << std::endl;
+                break;
+            }
+            written += std::max<ssize_t>(n, 0);
+        }
+        fdatasync(journalFile);
+
+        // A batch starting with a base record (load, save, new) resyncs the replica even if it had drifted
+        bool wasEdited = replicaEdited;
+        std::string previousPath = replicaPath;
+        size_t valid = replayJournal(batch.data(), batch.size(), truncate, replica, replicaPath, replicaFinalNewline, replicaEdited);
+        replicaValid = valid == batch.size() && (replicaValid || truncate);
+        if (truncate && wasEdited) {
+            remove(autosavePath(previousPath).c_str());
+        }
+        batch.clear();
+    }
+}
+
+// Opens the journal keeping its first `validLength` bytes, those recovered at startup
+void startJournal(off_t validLength) {
+    journalFile = open(JOURNAL_PATH, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (journalFile < 0) {
+        std::cout << "Cannot open the journal: " << strerror(errno) << std::endl;
+        return;
+    }
+    if (ftruncate(journalFile, validLength) != 0) {
+        validLength = 0;
+    }
+
+    journalStopping = false;
+    journalRunning = true;
+    journalThread = std::thread(journalWriter, validLength);
+
+    if (validLength == 0) {
+        journalReset(documentPath);
+    }
+}
+
+// Flushes what is left; the journal is only removed on a clean exit
+void stopJournal(bool remove) {
+    if (!journalRunning) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        journalStopping = true;
+    }
+    journalWakeUp.notify_one();
+    journalThread.join();
+    journalRunning = false;
+
+    close(journalFile);
+    if (remove) {
+        unlink(JOURNAL_PATH);
+    }
+}
+#pragma endregion
+
+
+#pragma region HISTORY
+// Undo and redo both swap `text` with the `count` lines at `first`,
+// so a hunk always holds the other side of the edit
+struct EditHunk {
+    int first;
+    int count;
+    std::vector<std::string> text;
+};
+
+struct UndoStep {
+    std::vector<EditHunk> hunks;
+    int cursorX;
+    int cursorY;
+};
+
+std::deque<UndoStep> undoHistory;
+std::vector<UndoStep> redoHistory;
+
+int transactionDepth = 0;
+UndoStep transaction;
+
+EditHunk pendingHunk;
+bool pendingUndoable;
+
+// Keystrokes typed or erased in one line undo together, as long as each lands where the
+// previous one left the cursor. Any other step, or an undo, ends the run
+bool typingEdit = false;        // the edit being made is a keystroke, see beginTyping()
+bool typingStepOpen = false;    // undoHistory.back() is such a run
+bool transactionTyping = false; // the transaction ends with a keystroke
+int typedX = -1;                // the cursor after the last keystroke
+int typedY = -1;
+
+// Keeps every per-line cache in step with `lines`
+void spliceLineCaches(int first, int removed, int inserted) {
+    spliceLayout(first, removed, inserted);
+    spliceViews(first, removed, inserted);
+    spliceMinimap(first, removed, inserted);
+    spliceStats(first, removed, inserted);
+    spliceBrackets(first, removed, inserted);
+    spliceFolds(first, removed, inserted);
+    spliceHighlights(first, removed, inserted);
+}
+
+void finishLineCaches(int first, bool bulk) {
+    finishLayoutUpdate(first, bulk);
+    relexEditedLines();
+}
+
+void recordStep(UndoStep&& step) {
+    typingStepOpen = false;
+    redoHistory.clear();
+    undoHistory.push_back(std::move(step));
+    if (static_cast<int>(undoHistory.size()) > UNDO_HISTORY_LIMIT) {
+        undoHistory.pop_front();
+    }
+}
+
+void recordHunk(EditHunk&& hunk) {
+    // The step of the run already holds the line as it was before it
+    bool joins = typingEdit && typingStepOpen && undoHistory.size() && redoHistory.empty() && cursorX == typedX && cursorY == typedY;
+    if (joins && (transactionDepth == 0 || transaction.hunks.empty())) {
+        transactionTyping = true;
+        return;
+    }
+
+    if (transactionDepth > 0) {
+        transaction.hunks.push_back(std::move(hunk));
+        transactionTyping = typingEdit;
+        return;
+    }
+
+    recordStep({{std::move(hunk)}, cursorX, cursorY});
+    typingStepOpen = typingEdit;
+}
+
+// Around the edit of a keystroke that changes only the cursor line
+void beginTyping() {
+    typingEdit = true;
+}
+
+void endTyping() {
+    typingEdit = false;
+    typedX = cursorX;
+    typedY = cursorY;
+}
+
+// Groups every edit until the matching endTransaction() into one undo step
+void beginTransaction() {
+    if (transactionDepth++ == 0) {
+        transaction = {{}, cursorX, cursorY};
+        transactionTyping = false;
+    }
+}
+
+void endTransaction() {
+    if (--transactionDepth == 0 && transaction.hunks.size()) {
+        recordStep(std::move(transaction));
+        typingStepOpen = transactionTyping;
+    }
+}
+
+void clearHistory() {
+    typingStepOpen = false;
+    undoHistory.clear();
+    redoHistory.clear();
+}
+
+// Every change to `lines` is wrapped in beginEdit() / endEdit() so the pool never
+// reads a line being edited. `removed` lines starting at `first` are about to change.
+void beginEdit(int first, int removed, bool undoable = true) {
+    documentVersion++;
+    pauseBackgroundWork();
+
+    pendingHunk = {first, removed, {}};
+    pendingUndoable = undoable;
+    if (undoable) {
+        pendingHunk.text.assign(lines.begin() + first, lines.begin() + first + removed);
+    }
+}
+
+// The lines announced by beginEdit() were replaced by `inserted` new ones
+void endEdit(int inserted) {
+    resumeBackgroundWork();
+
+    int first = pendingHunk.first;
+    int removed = pendingHunk.count;
+    spliceLineCaches(first, removed, inserted);
+
+    // Big inserts (loads, pastes) only get their visible part wrapped right away
+    bool bulk = inserted > LAYOUT_CHUNK_LINES;
+    for (int i = first; i < first + inserted && !bulk; i++) {
+        wrapDirtyLine(i);
+    }
+    finishLineCaches(first, bulk);
+
+    if (pendingUndoable) {
+        journalSplice(first, removed, inserted);
+        pendingHunk.count = inserted;
+        recordHunk(std::move(pendingHunk));
+    }
+    // Lines appended at the end (progressive loading) leave every recorded hunk valid
+    else if (removed > 0 || first + inserted != static_cast<int>(lines.size())) {
+        clearHistory();
+    }
+}
+
+// Swaps every hunk of `step` into the document as a single edit, backwards when undoing
+void applyStep(UndoStep& step, bool backwards) {
+    int inserted = 0;
+    for (const EditHunk& hunk : step.hunks) {
+        inserted += static_cast<int>(hunk.text.size());
+    }
+    bool bulk = inserted > LAYOUT_CHUNK_LINES;
+    int first = static_cast<int>(lines.size());
+
+    documentVersion++;
+    pauseBackgroundWork();
+
+    for (int n = 0; n < static_cast<int>(step.hunks.size()); n++) {
+        EditHunk& hunk = step.hunks[backwards ? step.hunks.size() - 1 - n : n];
+        int count = static_cast<int>(hunk.text.size());
+
+        if (count == hunk.count) {
+            std::swap_ranges(hunk.text.begin(), hunk.text.end(), lines.begin() + hunk.first);
+        } else {
+            std::vector<std::string> current(std::make_move_iterator(lines.begin() + hunk.first), std::make_move_iterator(lines.begin() + hunk.first + hunk.count));
+            lines.erase(lines.begin() + hunk.first, lines.begin() + hunk.first + hunk.count);
+            lines.insert(lines.begin() + hunk.first, std::make_move_iterator(hunk.text.begin()), std::make_move_iterator(hunk.text.end()));
+            hunk.text = std::move(current);
+        }
+
+        spliceLineCaches(hunk.first, hunk.count, count);
+        for (int i = hunk.first; i < hunk.first + count && !bulk; i++) {
+            wrapDirtyLine(i);
+        }
+        journalSplice(hunk.first, hunk.count, count);
+
+        hunk.count = count;
+        first = std::min(first, hunk.first);
+    }
+
+    resumeBackgroundWork();
+
+    finishLineCaches(std::min(first, static_cast<int>(lines.size()) - 1), bulk);
+}
+#pragma endregion
+
+
+#pragma region REGEX
+// Patterns are compiled once into a Thompson NFA, then matched through a DFA
+// whose states are built lazily, one (state, byte) transition at a time.
+// Supported: literals, . [] [^] \d \w \s (and negations), groups, | * + ?,
+// and ^ / $ anchoring the whole pattern to the line.
+struct NfaState {
+    enum Type { SET, SPLIT, JUMP, MATCH };
+
+    Type type;
+    std::bitset<256> set;
+    int out = -1;
+    int out1 = -1;
+};
+
+struct Regex {
+    std::vector<NfaState> states;
+    int start = -1;
+    bool anchoredStart = false;
+    bool anchoredEnd = false;
+    std::shared_ptr<const Regex> reversed;  // the pattern read backwards, to find where matches start
+};
+
+// `reversed` builds the NFA of the pattern read from right to left, which matches mirrored text
+class RegexParser {
+public:
+    RegexParser(const std::string& pattern, Regex& regex, bool reversed = false) : pattern(pattern), regex(regex), reversed(reversed) {}
+
+    bool compile() {
+        size_t end = pattern.size();
+        if (pattern.size() && pattern[0] == '^') {
+            regex.anchoredStart = true;
+            pos = 1;
+        }
+        if (end > pos && pattern[end - 1] == '$') {
+            int escapes = 0;
+            for (size_t i = end - 1; i > pos && pattern[i - 1] == '\\'; i--) {
+                escapes++;
+            }
+            if (escapes % 2 == 0) {
+                regex.anchoredEnd = true;
+                pattern.pop_back();
+            }
+        }
+
+        Fragment body = parseAlternation();
+        if (!ok || pos != pattern.size()) {
+            return false;
+        }
+
+        int match = addState(NfaState::MATCH);
+        patch(body.outs, match);
+        regex.start = body.start;
+        if (reversed) {
+            std::swap(regex.anchoredStart, regex.anchoredEnd);
+        }
+        return true;
+    }
+
+private:
+    struct Fragment {
+        int start;
+        std::vector<std::pair<int, int>> outs;  // dangling (state, slot) arrows
+    };
+
+    std::string pattern;
+    Regex& regex;
+    bool reversed;
+    size_t pos = 0;
+    bool ok = true;
+
+    int addState(NfaState::Type type, int out = -1, int out1 = -1) {
+        NfaState state;
+        state.type = type;
+        state.out = out;
+        state.out1 = out1;
+        regex.states.push_back(state);
+        return static_cast<int>(regex.states.size()) - 1;
+    }
+
+    void patch(const std::vector<std::pair<int, int>>& outs, int target) {
+        for (const auto& out : outs) {
+            (out.second ? regex.states[out.first].out1 : regex.states[out.first].out) = target;
+        }
+    }
+
+    bool more() const {
+        return pos < pattern.size();
+    }
+
+    Fragment parseAlternation() {
+        Fragment left = parseConcatenation();
+        while (ok && more() && pattern[pos] == '|') {
+            pos++;
+            Fragment right = parseConcatenation();
+            int split = addState(NfaState::SPLIT, left.start, right.start);
+            left.start = split;
+            left.outs.insert(left.outs.end(), right.outs.begin(), right.outs.end());
+        }
+        return left;
+    }
+
+    Fragment parseConcatenation() {
+        int empty = addState(NfaState::JUMP);
+        Fragment result = {empty, {{empty, 0}}};
+
+        while (ok && more() && pattern[pos] != '|' && pattern[pos] != ')') {
+            Fragment next = parseRepetition();
+            if (reversed) {
+                patch(next.outs, result.start);
+                result.start = next.start;
+            } else {
+                patch(result.outs, next.start);
+                result.outs = next.outs;
+            }
+        }
+        return result;
+    }
+
+    Fragment parseRepetition() {
+        Fragment atom = parseAtom();
+        while (ok && more() && (pattern[pos] == '*' || pattern[pos] == '+' || pattern[pos] == '?')) {
+            char op = pattern[pos++];
+            int split = addState(NfaState::SPLIT, atom.start);
+            if (op == '*') {
+                patch(atom.outs, split);
+                atom = {split, {{split, 1}}};
+            } else if (op == '+') {
+                patch(atom.outs, split);
+                atom = {atom.start, {{split, 1}}};
+            } else {
+                atom.outs.push_back({split, 1});
+                atom.start = split;
+            }
+        }
+        return atom;
+    }
+
+    Fragment parseAtom() {
+        if (!more()) {
+            ok = false;
+            return {0, {}};
+        }
+
+        char c = pattern[pos++];
+        if (c == '(') {
+            Fragment inner = parseAlternation();
+            if (!more() || pattern[pos] != ')') {
+                ok = false;
+                return inner;
+            }
+            pos++;
+            return inner;
+        }
+        if (c == '*' || c == '+' || c == '?' || c == ')') {
+            ok = false;
+            return {0, {}};
+        }
+
+        int state = addState(NfaState::SET);
+        std::bitset<256>& set = regex.states[state].set;
+        if (c == '.') {
+            set.set();
+        } else if (c == '[') {
+            parseClass(set);
+        } else if (c == '\\') {
+            parseEscape(set);
+        } else {
+            set.set(static_cast<unsigned char>(c));
+        }
+        return {state, {{state, 0}}};
+    }
+
+    void parseEscape(std::bitset<256>& set) {
+        if (!more()) {
+            ok = false;
+            return;
+        }
+
+        char c = pattern[pos++];
+        std::bitset<256> shorthand;
+        switch (c) {
+            case 'd': case 'D':
+                for (int b = '0'; b <= '9'; b++) shorthand.set(b);
+                break;
+            case 'w': case 'W':
+                for (int b = 0; b < 256; b++) shorthand[b] = isalnum(b) || b == '_';
+                break;
+            case 's': case 'S':
+                for (char b : std::string(" \t\r\n\f\v")) shorthand.set(static_cast<unsigned char>(b));
+                break;
+            case 't':
+                set.set('\t');
+                return;
+            default:
+                set.set(static_cast<unsigned char>(c));
+                return;
+        }
+        set |= isupper(c) ? ~shorthand : shorthand;
+    }
+
+    void parseClass(std::bitset<256>& set) {
+        bool negated = more() && pattern[pos] == '^';
+        if (negated) {
+            pos++;
+        }
+
+        bool first = true;
+        while (more() && (pattern[pos] != ']' || first)) {
+            first = false;
+            std::bitset<256> item;
+            int low = static_cast<unsigned char>(pattern[pos]);
+            if (pattern[pos++] == '\\') {
+                parseEscape(item);
+                set |= item;
+                continue;
+            }
+            if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+                int high = static_cast<unsigned char>(pattern[pos + 1]);
+                pos += 2;
+                for (int b = low; b <= high; b++) {
+                    set.set(b);
+                }
+            } else {
+                set.set(low);
+            }
+        }
+
+        if (!more()) {
+            ok = false;
+            return;
+        }
+        pos++;
+
+        if (negated) {
+            set.flip();
+        }
+    }
+};
+
+// Replaces `set` by the sorted SET and MATCH states reachable from it without reading a byte
+void regexClosure(const Regex& regex, std::vector<int>& set) {
+    std::vector<int> stack = set;
+    std::vector<bool> seen(regex.states.size());
+    set.clear();
+
+    while (stack.size()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (s < 0 || seen[s]) {
+            continue;
+        }
+        seen[s] = true;
+
+        const NfaState& state = regex.states[s];
+        if (state.type == NfaState::SPLIT) {
+            stack.push_back(state.out1);
+            stack.push_back(state.out);
+        } else if (state.type == NfaState::JUMP) {
+            stack.push_back(state.out);
+        } else {
+            set.push_back(s);
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+class LazyDfa {
+public:
+    explicit LazyDfa(const Regex& regex) : regex(regex) {
+        reset();
+        if (regex.reversed) {
+            backward = std::make_unique<LazyDfa>(*regex.reversed);
+        }
+    }
+
+    // Length of the longest match starting at `from`, -1 when there is none
+    int longestMatch(const char* text, int length, int from) {
+        int state = anchoredStart;
+        int longest = -1;
+        for (int i = from; ; i++) {
+            if (states[state].accepting && (!regex.anchoredEnd || i == length)) {
+                longest = i - from;
+            }
+            if (i == length || state == dead) {
+                break;
+            }
+            state = step(state, static_cast<unsigned char>(text[i]));
+        }
+        return longest;
+    }
+
+    // Flags every position a match starts at, in one pass of the reversed pattern from the end
+    const std::vector<char>& matchStarts(const char* text, int length) {
+        LazyDfa& dfa = *backward;
+        starts.assign(length + 1, 0);
+        int state = dfa.regex.anchoredStart ? dfa.anchoredStart : dfa.unanchoredStart;
+        for (int i = length; state != dfa.dead; i--) {
+            starts[i] = dfa.states[state].accepting;
+            if (i == 0) {
+                break;
+            }
+            state = dfa.step(state, static_cast<unsigned char>(text[i - 1]));
+        }
+        return starts;
+    }
+
+    // Whether a match ends anywhere in the text, in one linear pass
+    bool anyMatch(const char* text, int length) {
+        int state = unanchoredStart;
+        for (int i = 0; ; i++) {
+            if (states[state].accepting && (!regex.anchoredEnd || i == length)) {
+                return true;
+            }
+            if (i == length) {
+                return false;
+            }
+            state = step(state, static_cast<unsigned char>(text[i]));
+        }
+    }
+
+private:
+    struct DfaState {
+        std::vector<int> nfa;
+        bool unanchored;
+        bool accepting;
+        int next[256];
+    };
+
+    const Regex& regex;
+    std::unique_ptr<LazyDfa> backward;
+    std::vector<char> starts;
+    std::vector<DfaState> states;
+    std::map<std::pair<std::vector<int>, bool>, int> ids;
+    std::vector<int> startSet;
+    int anchoredStart;
+    int unanchoredStart;
+    int dead;
+
+    void reset() {
+        states.clear();
+        ids.clear();
+        startSet = {regex.start};
+        regexClosure(regex, startSet);
+        anchoredStart = stateFor(startSet, false);
+        unanchoredStart = stateFor(startSet, true);
+        dead = stateFor({}, false);
+    }
+
+    int stateFor(const std::vector<int>& set, bool unanchored) {
+        auto key = std::make_pair(set, unanchored);
+        auto it = ids.find(key);
+        if (it != ids.end()) {
+            return it->second;
+        }
+
+        DfaState state;
+        state.nfa = set;
+        state.unanchored = unanchored;
+        state.accepting = false;
+        for (int s : set) {
+            state.accepting |= regex.states[s].type == NfaState::MATCH;
+        }
+        std::fill(std::begin(state.next), std::end(state.next), -1);
+
+        states.push_back(std::move(state));
+        ids[key] = static_cast<int>(states.size()) - 1;
+        return static_cast<int>(states.size()) - 1;
+    }
+
+    int step(int state, unsigned char c) {
+        int next = states[state].next[c];
+        if (next >= 0) {
+            return next;
+        }
+
+        // A full cache starts over from the state the scan is in, however long the line
+        if (static_cast<int>(states.size()) >= DFA_STATE_LIMIT) {
+            std::vector<int> current = std::move(states[state].nfa);
+            bool unanchored = states[state].unanchored;
+            reset();
+            state = stateFor(current, unanchored);
+        }
+
+        // An unanchored state keeps trying to start a match at every byte
+        std::vector<int> set;
+        for (int s : states[state].nfa) {
+            if (regex.states[s].type == NfaState::SET && regex.states[s].set[c]) {
+                set.push_back(regex.states[s].out);
+            }
+        }
+        bool unanchored = states[state].unanchored;
+        if (unanchored) {
+            set.insert(set.end(), startSet.begin(), startSet.end());
+        }
+        regexClosure(regex, set);
+
+        next = stateFor(set, unanchored);
+        states[state].next[c] = next;
+        return next;
+    }
+};
+
+// Compiles `pattern`, nullptr when it is not a valid expression
+std::shared_ptr<const Regex> compileRegex(const std::string& pattern) {
+    auto regex = std::make_shared<Regex>();
+    if (!RegexParser(pattern, *regex).compile()) {
+        return nullptr;
+    }
+
+    auto reversed = std::make_shared<Regex>();
+    RegexParser(pattern, *reversed, true).compile();
+    regex->reversed = reversed;
+    return regex;
+}
+
+// Appends (start, length) of every leftmost-longest, non-overlapping match in `text`.
+// Lines without any match are rejected by a single unanchored pass; on the others a backward pass
+// finds where matches start, so the forward DFA only runs from those and never rescans a near miss.
+void findAllRegex(LazyDfa& dfa, const Regex& regex, const char* text, int length, std::vector<std::pair<int, int>>& found, bool allowEmpty) {
+    if (!regex.anchoredStart && !dfa.anyMatch(text, length)) {
+        return;
+    }
+
+    const std::vector<char>* starts = regex.anchoredStart ? nullptr : &dfa.matchStarts(text, length);
+    int lastEnd = -1;
+    for (int i = 0; i <= length; ) {
+        bool candidate = !starts || (*starts)[i];
+        int matched = candidate ? dfa.longestMatch(text, length, i) : -1;
+
+        if (matched > 0 || (matched == 0 && allowEmpty && i != lastEnd)) {
+            found.push_back({i, matched});
+            lastEnd = i + matched;
+        }
+        if (regex.anchoredStart) {
+            break;
+        }
+        i += std::max(1, matched);
+    }
+}
+
+// `replacement` with $0 (or $&) standing for the matched text and $$ for a dollar
+std::string expandReplacement(const std::string& replacement, const char* match, int length) {
+    std::string expanded;
+    for (size_t i = 0; i < replacement.size(); i++) {
+        if (replacement[i] == '$' && i + 1 < replacement.size()) {
+            char next = replacement[i + 1];
+            if (next == '0' || next == '&') {
+                expanded.append(match, length);
+                i++;
+                continue;
+            }
+            if (next == '$') {
+                expanded += '$';
+                i++;
+                continue;
+            }
+        }
+        expanded += replacement[i];
+    }
+    return expanded;
+}
+#pragma endregion
+
+
+#pragma region SEARCH
+// Appends (start, length) of every non-overlapping occurrence of `needle` in `haystack`.
+// Candidates must match the needle's first and last bytes, which SSE2 tests
+// 16 positions at a time, and are then verified with memcmp.
+void findAll(const char* haystack, int length, const std::string& needle, std::vector<std::pair<int, int>>& found) {
+    int m = static_cast<int>(needle.size());
+    if (m == 0 || length < m) {
+        return;
+    }
+
+    int nextAllowed = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+
+    for (; i + m - 1 + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            int candidate = i + __builtin_ctz(mask);
+            if (candidate >= nextAllowed && memcmp(haystack + candidate + 1, needle.data() + 1, m - 1) == 0) {
+                found.push_back({candidate, m});
+                nextAllowed = candidate + m;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + m <= length; i++) {
+        if (i >= nextAllowed && haystack[i] == needle[0] && memcmp(haystack + i, needle.data(), m) == 0) {
+            found.push_back({i, m});
+            nextAllowed = i + m;
+        }
+    }
+}
+
+// Appends the offset of every '\n' in `text`, testing 16 bytes per SSE2 compare
+void findNewlines(const char* text, size_t length, std::vector<size_t>& found) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        while (mask) {
+            found.push_back(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (text[i] == '\n') {
+            found.push_back(i);
+        }
+    }
+}
+
+// Matches of `query` in `line`; `regex` (and its `dfa`) is null in plain text mode
+void matchLine(const std::string& line, const std::string& query, const Regex* regex, LazyDfa* dfa, std::vector<std::pair<int, int>>& found, bool allowEmpty) {
+    if (regex) {
+        findAllRegex(*dfa, *regex, line.data(), static_cast<int>(line.size()), found, allowEmpty);
+    } else {
+        findAll(line.data(), static_cast<int>(line.size()), query, found);
+    }
+}
+
+// Compiles the query when in regex mode, false if it does not parse
+bool compileQuery(std::shared_ptr<const Regex>& regex) {
+    regex = nullptr;
+    if (searchRegexMode) {
+        regex = compileRegex(searchQuery);
+        searchError = !regex;
+        return !searchError;
+    }
+    searchError = false;
+    return true;
+}
+
+// Scans the document in the pool, starting with the chunk on screen so it lights up first
+void startSearch() {
+    unsigned generation = ++searchGeneration;
+    unsigned version = documentVersion;
+    std::string query = searchQuery;
+
+    searchVersion = version;
+    searchMatchCount = 0;
+    searchChunks.assign((lines.size() + SEARCH_CHUNK_LINES - 1) / SEARCH_CHUNK_LINES, std::vector<SearchMatch>());
+    {
+        std::lock_guard<std::mutex> lock(searchResultsMutex);
+        searchResults.clear();
+    }
+
+    std::shared_ptr<const Regex> regex;
+    if (query.empty() || !compileQuery(regex)) {
+        return;
+    }
+
+    int chunkCount = static_cast<int>(searchChunks.size());
+    int visibleChunk = lineAtVisual(scrollPosition) / SEARCH_CHUNK_LINES;
+
+    for (int k = 0; k < chunkCount; k++) {
+        int chunk = (visibleChunk + k) % chunkCount;
+
+        searchTasksPending++;
+        pool->submit([chunk, generation, version, query, regex] {
+            SearchResult result = {chunk, generation, {}};
+            std::unique_ptr<LazyDfa> dfa(regex ? new LazyDfa(*regex) : nullptr);
+            std::vector<std::pair<int, int>> found;
+            {
+                std::shared_lock<std::shared_mutex> lock(documentMutex);
+                int last = std::min(static_cast<int>(lines.size()), (chunk + 1) * SEARCH_CHUNK_LINES);
+                for (int i = chunk * SEARCH_CHUNK_LINES; i < last; i++) {
+                    if (searchGeneration != generation || documentVersion != version) {
+                        break;
+                    }
+                    found.clear();
+                    matchLine(lines[i], query, regex.get(), dfa.get(), found, false);
+                    for (const auto& match : found) {
+                        result.matches.push_back({i, match.first, match.second});
+                    }
+                }
+            }
+            if (searchGeneration == generation && documentVersion == version) {
+                std::lock_guard<std::mutex> lock(searchResultsMutex);
+                searchResults.push_back(std::move(result));
+            }
+            searchTasksPending--;
+        });
+    }
+}
+
+// Runs body(0) .. body(count - 1) on the pool and waits for all of them
+void parallelFor(int count, const std::function<void(int)>& body) {
+    std::mutex doneMutex;
+    std::condition_variable done;
+    int remaining = count;
+
+    for (int k = 0; k < count; k++) {
+        pool->submit([&, k] {
+            body(k);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&] { return remaining == 0; });
+}
+
+// Rewrites every matching line in parallel, then swaps them all in as one edit and one undo step
+void replaceAll() {
+    std::shared_ptr<const Regex> regex;
+    if (searchQuery.empty() || !compileQuery(regex)) {
+        return;
+    }
+
+    int chunkCount = static_cast<int>((lines.size() + SEARCH_CHUNK_LINES - 1) / SEARCH_CHUNK_LINES);
+    std::vector<std::vector<EditHunk>> rewritten(chunkCount);
+
+    parallelFor(chunkCount, [&](int chunk) {
+        std::unique_ptr<LazyDfa> dfa(regex ? new LazyDfa(*regex) : nullptr);
+        std::vector<std::pair<int, int>> found;
+
+        std::shared_lock<std::shared_mutex> lock(documentMutex);
+        int last = std::min(static_cast<int>(lines.size()), (chunk + 1) * SEARCH_CHUNK_LINES);
+        for (int i = chunk * SEARCH_CHUNK_LINES; i < last; i++) {
+            found.clear();
+            matchLine(lines[i], searchQuery, regex.get(), dfa.get(), found, true);
+            if (found.empty()) {
+                continue;
+            }
+
+            const std::string& line = lines[i];
+            std::string text;
+            int copied = 0;
+            for (const auto& match : found) {
+                text.append(line, copied, match.first - copied);
+                text += expandReplacement(replaceQuery, line.data() + match.first, match.second);
+                copied = match.first + match.second;
+            }
+            text.append(line, copied, std::string::npos);
+
+            rewritten[chunk].push_back({i, 1, {std::move(text)}});
+        }
+    });
+
+    UndoStep step = {{}, cursorX, cursorY};
+    for (std::vector<EditHunk>& hunks : rewritten) {
+        std::move(hunks.begin(), hunks.end(), std::back_inserter(step.hunks));
+    }
+    if (step.hunks.empty()) {
+        return;
+    }
+
+    applyStep(step, false);
+    recordStep(std::move(step));
+}
+
+void stopSearch() {
+    searchGeneration++;
+    searchMatchCount = 0;
+    searchChunks.clear();
+}
+
+// Collects the chunks the pool finished since the last frame
+void applySearchResults() {
+    if (!searchActive) {
+        return;
+    }
+    if (searchVersion != documentVersion) {
+        startSearch();
+        return;
+    }
+
+    std::vector<SearchResult> results;
+    {
+        std::lock_guard<std::mutex> lock(searchResultsMutex);
+        results.swap(searchResults);
+    }
+
+    for (SearchResult& result : results) {
+        if (result.generation == searchGeneration) {
+            searchMatchCount += static_cast<int>(result.matches.size());
+            searchChunks[result.chunk] = std::move(result.matches);
+        }
+    }
+}
+
+// Matches found so far on line `i`
+std::pair<const SearchMatch*, const SearchMatch*> searchMatchesOn(int i) {
+    int chunk = i / SEARCH_CHUNK_LINES;
+    if (chunk >= static_cast<int>(searchChunks.size())) {
+        return {nullptr, nullptr};
+    }
+
+    const std::vector<SearchMatch>& matches = searchChunks[chunk];
+    auto first = std::lower_bound(matches.begin(), matches.end(), i, [](const SearchMatch& m, int line) { return m.line < line; });
+    auto last = std::upper_bound(first, matches.end(), i, [](int line, const SearchMatch& m) { return line < m.line; });
+    return {matches.data() + (first - matches.begin()), matches.data() + (last - matches.begin())};
+}
+#pragma endregion
+
+#pragma region VIEWER
+// Files of at least `viewerThreshold` bytes are not loaded into `lines`: they are mapped read-only
+// and a background task records where every VIEWER_CHECKPOINT_LINES-th line starts, so any line
+// is reached by scanning forward from the checkpoint before it. Only the visible rows are ever read.
+// The index task holds its own reference to the mapping, so closing the viewer never waits for it.
+struct ViewerMapping {
+    const char* data;
+    size_t size;
+
+    ViewerMapping(const void* data, size_t size) : data(static_cast<const char*>(data)), size(size) {}
+    ViewerMapping(const ViewerMapping&) = delete;
+    ViewerMapping& operator=(const ViewerMapping&) = delete;
+
+    ~ViewerMapping() {
+        munmap(const_cast<char*>(data), size);
+    }
+};
+
+bool viewerMode = false;
+std::string viewerPath;
+int viewerFile = -1;
+std::shared_ptr<ViewerMapping> viewerMapping;
+const char* viewerData = nullptr;   // viewerMapping's
+size_t viewerSize = 0;
+long long viewerTop = 0;
+size_t viewerThreshold = VIEWER_THRESHOLD_DEFAULT;
+
+std::mutex viewerIndexMutex;
+std::vector<size_t> viewerCheckpoints;  // offset of lines 0, N, 2N... guarded by viewerIndexMutex
+long long viewerNewlines = 0;           // guarded by viewerIndexMutex
+size_t viewerIndexedBytes = 0;          // guarded by viewerIndexMutex
+std::atomic<unsigned> viewerGeneration(0);
+
+// Counts the lines of [from, mapping->size), `newlines` being those before `from`, and publishes
+// checkpoints after every chunk until the viewer moves on to another generation
+void indexViewer(std::shared_ptr<ViewerMapping> mapping, unsigned generation, size_t from, long long newlines) {
+    const char* data = mapping->data;
+    size_t size = mapping->size;
+    std::vector<size_t> checkpoints;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t position = from; position < size && generation == viewerGeneration; ) {
+        size_t end = std::min(size, position + VIEWER_INDEX_CHUNK_BYTES);
+
+        checkpoints.clear();
+        const char* p = data + position;
+        const char* last = data + end;
+        while ((p = static_cast<const char*>(memchr(p, '\n', last - p)))) {
+            p++;
+            if (++newlines % VIEWER_CHECKPOINT_LINES == 0) {
+                checkpoints.push_back(p - data);
+            }
+        }
+
+        // Scanned pages are not needed anymore, keep them out of our resident set
+        size_t alignedStart = position / pageSize * pageSize;
+        size_t alignedEnd = end / pageSize * pageSize;
+        if (alignedEnd > alignedStart) {
+            madvise(const_cast<char*>(data) + alignedStart, alignedEnd - alignedStart, MADV_DONTNEED);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(viewerIndexMutex);
+            if (generation != viewerGeneration) {
+                break;
+            }
+            viewerCheckpoints.insert(viewerCheckpoints.end(), checkpoints.begin(), checkpoints.end());
+            viewerNewlines = newlines;
+            viewerIndexedBytes = end;
+        }
+        position = end;
+    }
+}
+
+// Indexes the mapping past the bytes indexed so far; a task still scanning stops publishing
+void startViewerIndex() {
+    unsigned generation = ++viewerGeneration;
+    size_t from;
+    long long newlines;
+    {
+        std::lock_guard<std::mutex> lock(viewerIndexMutex);
+        from = viewerIndexedBytes;
+        newlines = viewerNewlines;
+    }
+
+    std::shared_ptr<ViewerMapping> mapping = viewerMapping;
+    pool->submit([mapping, generation, from, newlines] { indexViewer(mapping, generation, from, newlines); });
+}
+
+// Lines known so far; a final '\n' does not open an extra empty line once the whole file is indexed
+long long viewerLineCount() {
+    std::lock_guard<std::mutex> lock(viewerIndexMutex);
+    bool complete = viewerIndexedBytes == viewerSize;
+    bool trailingNewline = viewerSize && viewerData[viewerSize - 1] == '\n';
+    return viewerNewlines + (complete && trailingNewline && viewerNewlines ? 0 : 1);
+}
+
+// Byte offset where `line` starts, found from the nearest checkpoint before it
+size_t viewerLineOffset(long long line) {
+    size_t offset;
+    long long remaining;
+    {
+        std::lock_guard<std::mutex> lock(viewerIndexMutex);
+        size_t k = std::min(static_cast<size_t>(line / VIEWER_CHECKPOINT_LINES), viewerCheckpoints.size() - 1);
+        offset = viewerCheckpoints[k];
+        remaining = line - static_cast<long long>(k) * VIEWER_CHECKPOINT_LINES;
+    }
+
+    for (; remaining > 0 && offset < viewerSize; remaining--) {
+        const char* p = static_cast<const char*>(memchr(viewerData + offset, '\n', viewerSize - offset));
+        offset = p ? p - viewerData + 1 : viewerSize;
+    }
+    return offset;
+}
+
+void closeViewer() {
+    if (!viewerMode) {
+        return;
+    }
+
+    viewerGeneration++;
+    viewerMapping.reset();      // unmapped here or by the index task once it sees the new generation
+    close(viewerFile);
+    viewerData = nullptr;
+    viewerSize = 0;
+    viewerFile = -1;
+    viewerMode = false;
+    viewerPath.clear();
+
+    std::lock_guard<std::mutex> lock(viewerIndexMutex);
+    std::vector<size_t>().swap(viewerCheckpoints);
+    viewerNewlines = 0;
+    viewerIndexedBytes = 0;
+}
+
+// Maps `path` and starts indexing it, false if the file cannot be mapped
+bool openViewer(const std::string& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0 || info.st_size == 0) {
+        if (file >= 0) {
+            close(file);
+        }
+        return false;
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    if (data == MAP_FAILED) {
+        close(file);
+        return false;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    viewerMode = true;
+    viewerPath = path;
+    viewerFile = file;
+    viewerMapping = std::make_shared<ViewerMapping>(data, info.st_size);
+    viewerData = viewerMapping->data;
+    viewerSize = viewerMapping->size;
+    viewerTop = 0;
+    {
+        std::lock_guard<std::mutex> lock(viewerIndexMutex);
+        viewerCheckpoints.assign(1, 0);
+        viewerNewlines = 0;
+        viewerIndexedBytes = 0;
+    }
+
+    startViewerIndex();
+    return true;
+}
+
+int viewerVisibleRows() {
+    return std::max(1, (windowHeight - UI.h) / lineHeight);
+}
+
+void scrollViewer(long long rows) {
+    long long last = std::max(0LL, viewerLineCount() - viewerVisibleRows());
+    viewerTop = std::max(0LL, std::min(viewerTop + rows, last));
+}
+
+bool handleViewerEvents(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_UP:
+            scrollViewer(-1);
+            return true;
+        case SDLK_DOWN:
+            scrollViewer(1);
+            return true;
+        case SDLK_PAGEUP:
+            scrollViewer(-viewerVisibleRows());
+            return true;
+        case SDLK_PAGEDOWN:
+            scrollViewer(viewerVisibleRows());
+            return true;
+        case SDLK_HOME:
+            scrollViewer(-viewerTop);
+            return true;
+        case SDLK_END:
+            scrollViewer(viewerLineCount());
+            return true;
+        case SDLK_o:
+        case SDLK_t:
+            return false;
+        default:
+            return true;    // read-only
+    }
+}
+
+// The viewer draws in window coordinates: line numbers of huge files would overflow the scrolled viewport
+void updateViewerScrollBar() {
+    int visibleHeight = windowHeight - UI.h;
+    long long count = viewerLineCount();
+    long long last = std::max(1LL, count - viewerVisibleRows());
+
+    viewport = {0, UI.h, windowWidth, visibleHeight};
+    scrollBar.x = windowWidth - SCROLL_BAR_WIDTH;
+    scrollBar.h = std::max(lineHeight / 2, static_cast<int>(visibleHeight * std::min(1.0, static_cast<double>(viewerVisibleRows()) / count)));
+    scrollBar.y = static_cast<int>((visibleHeight - scrollBar.h) * std::min(1.0, static_cast<double>(viewerTop) / last));
+}
+
+void renderViewer() {
+    SDL_RenderSetViewport(renderer, &viewport);
+
+    long long count = viewerLineCount();
+    size_t offset = viewerLineOffset(viewerTop);
+    for (int row = 0; row <= viewerVisibleRows() && viewerTop + row < count; row++) {
+        int y = row * lineHeight + 2;
+
+        const char* newline = static_cast<const char*>(memchr(viewerData + offset, '\n', viewerSize - offset));
+        size_t end = newline ? newline - viewerData : viewerSize;
+        std::string text(viewerData + offset, std::min(end - offset, VIEWER_LINE_BYTES_MAX));
+        offset = std::min(end + 1, viewerSize);
+
+        if (text.size() && text.back() == '\r') {
+            text.pop_back();
+        }
+
+        // Render Line Index
+        std::string index = std::to_string(viewerTop + row);
+        SDL_Surface* iS = TTF_RenderText_Blended(font, index.c_str(), UIColor[currentTheme]);
+        SDL_Texture* iT = SDL_CreateTextureFromSurface(renderer, iS);
+        SDL_Rect iR = {2, y, iS->w, iS->h};
+        SDL_RenderCopy(renderer, iT, nullptr, &iR);
+        SDL_FreeSurface(iS);
+        SDL_DestroyTexture(iT);
+
+        // Render Line Text, unwrapped
+        if (text.size()) {
+            text = expandTabs(text);
+            SDL_Surface* tS = TTF_RenderText_Blended(font, text.c_str(), fontColor[currentTheme]);
+            SDL_Texture* tT = SDL_CreateTextureFromSurface(renderer, tS);
+            SDL_Rect tR = {editorLeftMargin, y, tS->w, tS->h};
+            SDL_RenderCopy(renderer, tT, nullptr, &tR);
+            SDL_FreeSurface(tS);
+            SDL_DestroyTexture(tT);
+        }
+    }
+
+    SDL_RenderSetViewport(renderer, nullptr);
+}
+
+// "read-only, indexing 42%" then "read-only, 123456 lines"
+std::string viewerStatus() {
+    size_t indexed;
+    {
+        std::lock_guard<std::mutex> lock(viewerIndexMutex);
+        indexed = viewerIndexedBytes;
+    }
+
+    if (indexed < viewerSize) {
+        return "read-only, indexing " + std::to_string(indexed * 100 / viewerSize) + "%";
+    }
+    return "read-only, " + std::to_string(viewerLineCount()) + " lines";
+}
+#pragma endregion
+
+
+void initRects() {
+    UI = {0, 0, windowWidth, 30};
+    viewport = {0, UI.h, windowWidth, windowHeight - UI.h};
+    editorArea = {0, UI.h, windowWidth, windowHeight - UI.h - STATUS_BAR_HEIGHT};
+    viewFrame = editorArea;
+    views[0].frame = editorArea;
+
+    scrollBar = {windowWidth - SCROLL_BAR_WIDTH, 0, SCROLL_BAR_WIDTH, 0};
+
+    saveButtonBox = {BUTTON_SPAN, BUTTON_SPAN, BUTTON_WIDTH, UI.h-10};
+    loadButtonBox = {BUTTON_SPAN + saveButtonBox.x + saveButtonBox.w, BUTTON_SPAN, BUTTON_WIDTH, UI.h-10};
+    minusButtonBox = {loadButtonBox.x + loadButtonBox.w + BUTTON_SPAN, BUTTON_SPAN, UI.h - 10, UI.h - 10};
+    sizeButtonBox = {minusButtonBox.x + minusButtonBox.w, BUTTON_SPAN, 40, UI.h - 10};
+    plusButtonBox = {sizeButtonBox.x + sizeButtonBox.w, BUTTON_SPAN, UI.h - 10, UI.h - 10};
+    themeButtonBox = {windowWidth - UI.h + 5, BUTTON_SPAN, UI.h - 10, UI.h - 10};
+
+    searchBox = {0, windowHeight - STATUS_BAR_HEIGHT - UI.h, windowWidth, UI.h};
+    statusBox = {0, windowHeight - STATUS_BAR_HEIGHT, windowWidth, STATUS_BAR_HEIGHT};
+}
+
+void updateRects() {
+    UI.w = windowWidth;
+    editorArea.w = windowWidth;
+    editorArea.h = windowHeight - UI.h - STATUS_BAR_HEIGHT;
+
+    themeButtonBox.x = windowWidth - UI.h + 5;
+
+    searchBox.y = windowHeight - STATUS_BAR_HEIGHT - UI.h;
+    searchBox.w = windowWidth;
+
+    statusBox.y = windowHeight - STATUS_BAR_HEIGHT;
+    statusBox.w = windowWidth;
+}
+
+bool init() {
+    bool success = true;
+    if (SDL_Init(SDL_INIT_EVERYTHING) == 0) {
+        std::cout << "Subsystems initialized!..." << std::endl;
+
+        window = SDL_CreateWindow(
+            "Ogmios", 
+            SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            WINDOW_WIDTH_DEFAULT, WINDOW_HEIGHT_DEFAULT,
+            SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+            );
+        if (window) {
+            std::cout << "Window created!" << std::endl;
+        } else {
+            success = false;
+        }
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (renderer) {
+            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+            std::cout << "Renderer created!" << std::endl;
+        } else {
+            success = false;
+        }
+    } else {
+        success = false;
+    }
+    if (TTF_Init() == -1) {
+        std::cout << "Error initializing SDL_TTF!" << std::endl;
+        success = false;
+    }
+
+    font = TTF_OpenFont("fonts/Nunito-Regular.ttf", DEFAULT_FONT_SIZE);
+    currentFontSize = DEFAULT_FONT_SIZE;
+    updateFontMetrics();
+
+    windowWidth = WINDOW_WIDTH_DEFAULT;
+    windowHeight = WINDOW_HEIGHT_DEFAULT;
+    SDL_SetWindowMinimumSize(window, WINDOW_WIDTH_MIN, WINDOW_HEIGHT_MIN);
+
+    lineHeight = DEFAULT_LINE_HEIGHT;
+    editorLeftMargin = DEFAULT_EDITOR_LEFT_MARGIN;
+
+    rCursorX = editorLeftMargin;
+    rCursorY = 0;
+
+    nativeDialogs = getenv("OGMIOS_NATIVE_DIALOGS") != nullptr;
+    if (const char* threshold = getenv("OGMIOS_VIEWER_THRESHOLD_MB")) {
+        viewerThreshold = static_cast<size_t>(std::max(1L, atol(threshold))) << 20;
+    }
+
+    pool = std::make_unique<ThreadPool>(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    dialogEvent = SDL_RegisterEvents(1);
+    tinyfd_detectPresenceAsync();
+    visualLineStart.assign(1, 0);
+
+    initRects();
+    updateRects();
+    layoutWidth = wrapWidth(viewFrame);
+
+    #pragma region INIT THEMES
+    //  DAY
+    fontColor[DAY] = {65, 34, 52, 255};
+    cursorColor[DAY] = {204, 0, 153, 255};
+    UIColor[DAY] = {50, 26, 40, 255};
+    textBackgroundColor[DAY] = {234, 215, 215, 255};
+    UIBackgroundColor[DAY] = {194, 173, 207, 255};
+    searchHighlightColor[DAY] = {255, 204, 102, 255};
+    selectionColor[DAY] = {204, 179, 230, 255};
+    bracketColor[DAY] = {255, 179, 209, 255};
+    tokenColor[DAY][TOKEN_TEXT] = fontColor[DAY];
+    tokenColor[DAY][TOKEN_KEYWORD] = {153, 0, 102, 255};
+    tokenColor[DAY][TOKEN_STRING] = {0, 128, 64, 255};
+    tokenColor[DAY][TOKEN_NUMBER] = {0, 102, 153, 255};
+    tokenColor[DAY][TOKEN_COMMENT] = {140, 120, 130, 255};
+    themesIcons[DAY] = LoadTexture("./icons/sun.png");
+
+    //  NIGHT
+    fontColor[NIGHT] = {255, 255, 255, 255};
+    cursorColor[NIGHT] = {255, 255, 255, 255};
+    UIColor[NIGHT] = {255, 255, 255, 255};
+    textBackgroundColor[NIGHT] = {0, 0, 0, 255};
+    UIBackgroundColor[NIGHT] = {128, 128, 128, 255};
+    searchHighlightColor[NIGHT] = {153, 102, 0, 255};
+    selectionColor[NIGHT] = {64, 64, 128, 255};
+    bracketColor[NIGHT] = {96, 96, 96, 255};
+    tokenColor[NIGHT][TOKEN_TEXT] = fontColor[NIGHT];
+    tokenColor[NIGHT][TOKEN_KEYWORD] = {255, 153, 204, 255};
+    tokenColor[NIGHT][TOKEN_STRING] = {153, 230, 153, 255};
+    tokenColor[NIGHT][TOKEN_NUMBER] = {128, 204, 255, 255};
+    tokenColor[NIGHT][TOKEN_COMMENT] = {150, 150, 150, 255};
+    themesIcons[NIGHT] = LoadTexture("./icons/moon.png");
+
+    currentTheme = DAY;
+
+    #pragma endregion
+
+    SDL_Surface* icon = IMG_Load("icons/Ogmios.png");
+    SDL_SetWindowIcon(window, icon);
+
+    SDL_StartTextInput();
+
+    return success;
+}
+
+
+// Pixel position of the char boundary `x` of line `y`, the sub-line it sits on decides both coordinates
+void caretPosition(int x, int y, int& rx, int& ry) {
+    ensureLineLayout(y);
+
+    int j = sublineOf(y, x);
+    int start = sublineStart(y, j);
+    rx = textWidth(lines[y].substr(start), x - start) + editorLeftMargin;
+    ry = (rowOfLine(y) + j) * lineHeight;
+}
+
+// Wherever the cursor lands, the folds hiding its line open
+void updateRenderCursorX() {
+    revealLine(cursorY);
+    caretPosition(cursorX, cursorY, rCursorX, rCursorY);
+}
+
+void updateRenderCursorY() {
+    revealLine(cursorY);
+    ensureLineLayout(cursorY);
+
+    rCursorY = (rowOfLine(cursorY) + sublineOf(cursorY, cursorX)) * lineHeight;
+}
+
+
+void jumpToLineStart() {
+    cursorX = 0;
+    updateRenderCursorX();
+}
+
+void jumpToLineEnd() {
+    cursorX = static_cast<int>(lines[cursorY].size());
+    updateRenderCursorX();
+}
+
+void jumpToFileStart() {
+    cursorY = 0;
+    jumpToLineStart();
+    updateRenderCursorY();
+}
+
+void jumpToFileEnd() {
+    cursorY = static_cast<int>(lines.size() - 1);
+    jumpToLineEnd();
+    updateRenderCursorY();
+}
+
+
+// Whole rows, the view snaps to the top of one
+void scroll(int y) {
+    scrollPosition += y;
+    scrollPosition = std::max(0, std::min(scrollPosition, visualLineCount() - 1));
+    scrollPixels = 0;
+    scrollVelocity = 0;
+}
+
+// Any number of pixels, the glide stops at either end of the document
+void scrollPixelsBy(double pixels) {
+    double top = static_cast<double>(scrollPosition) * lineHeight + scrollPixels + pixels;
+    double last = static_cast<double>(visualLineCount() - 1) * lineHeight;
+    if (top <= 0 || top >= last) {
+        top = std::max(0.0, std::min(top, last));
+        scrollVelocity = 0;
+    }
+
+    scrollPosition = static_cast<int>(top / lineHeight);
+    scrollPixels = top - static_cast<double>(scrollPosition) * lineHeight;
+}
+
+// A wheel notch (fractions from touchpads) adds the speed that glides SCROLL_WHEEL_ROWS rows
+void flingScroll(double notches) {
+    scrollVelocity += notches * SCROLL_WHEEL_ROWS * lineHeight * SCROLL_FRICTION;
+}
+
+// Moves the view by what is left of the wheel's speed after `seconds`
+void glideScroll(double seconds) {
+    if (scrollVelocity == 0) {
+        return;
+    }
+
+    double decay = std::exp(-SCROLL_FRICTION * seconds);
+    double distance = scrollVelocity * (1 - decay) / SCROLL_FRICTION;
+    scrollVelocity *= decay;
+    if (std::fabs(scrollVelocity) < SCROLL_STOP_SPEED) {
+        scrollVelocity = 0;
+    }
+    scrollPixelsBy(distance);
+}
+
+void scrollToCursor() {
+    int row = rCursorY / lineHeight;
+    int visibleRows = std::max(1, viewFrame.h / lineHeight);
+
+    if (row < scrollPosition || (row == scrollPosition && scrollPixels > 0)) {
+        scroll(row - scrollPosition);
+    }
+    else if (row >= scrollPosition + visibleRows) {
+        scroll(row - scrollPosition - visibleRows + 1);
+    }
+}
+
+// Onto the partner of the bracket under or just before the cursor
+void jumpToMatchingBracket() {
+    int x, y, matchX, matchY;
+    if (viewerMode || !cursorBracketPair(x, y, matchX, matchY)) {
+        return;
+    }
+    cursorX = matchX;
+    cursorY = matchY;
+    updateRenderCursorY();
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+// Ctrl+Shift+[ folds the region the cursor line opens, Ctrl+Shift+] unfolds it
+void foldAtCursor() {
+    int last;
+    if (viewerMode || !foldRegionAt(cursorY, last)) {
+        return;
+    }
+    folds[cursorY] = last;
+    rebuildVisualIndexAnchored(static_cast<int>(lines.size()));
+    updateRenderCursorY();
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+void unfoldAtCursor() {
+    if (folds.erase(cursorY)) {
+        rebuildVisualIndexAnchored(static_cast<int>(lines.size()));
+        updateRenderCursorY();
+    }
+}
+
+
+void moveCursorUp() {
+    if (cursorY > 0) {
+        cursorY = visibleLineAt(cursorY - 1);
+        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+
+        updateRenderCursorY();
+        updateRenderCursorX();
+        scrollToCursor();
+    }
+}
+
+void moveCursorDown() {
+    if (nextVisibleLine(cursorY) < static_cast<int>(lines.size())) {
+        cursorY = nextVisibleLine(cursorY);
+        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+        updateRenderCursorY();
+        updateRenderCursorX();
+        scrollToCursor();
+    }
+}
+
+void moveCursorLeft() {
+    if (cursorX == 0) {
+        moveCursorUp();
+        cursorX = static_cast<int>(lines[cursorY].size());
+    }
+    else if (cursorX > 0) {
+        cursorX--;
+    }
+    updateRenderCursorX();
+}
+
+void moveCursorRight() {
+    if (cursorX == static_cast<int>(lines[cursorY].size())) {
+        moveCursorDown();
+        cursorX = 0;
+        updateRenderCursorX();
+    }
+    else {
+        cursorX++;
+        updateRenderCursorX();
+    }
+}
+
+
+void insertChar(char c) {
+    beginTyping();
+    beginEdit(cursorY, 1);
+    lines[cursorY].insert(cursorX, 1, c);
+    endEdit(1);
+
+    cursorX++;
+    endTyping();
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+void deletePreviousChar() {
+    if (cursorX > 0) {
+        beginTyping();
+        beginEdit(cursorY, 1);
+        lines[cursorY].erase(cursorX - 1, 1);
+        endEdit(1);
+
+        cursorX--;
+        endTyping();
+        updateRenderCursorX();
+    }
+}
+
+void deleteNextChar() {
+    if (cursorX < static_cast<int>(lines[cursorY].size())) {
+        beginTyping();
+        beginEdit(cursorY, 1);
+        lines[cursorY].erase(cursorX, 1);
+        endEdit(1);
+
+        endTyping();
+        updateRenderCursorX();
+    }
+}
+
+void insertTab() {
+    beginEdit(cursorY, 1);
+    lines[cursorY].insert(cursorX, "\t");
+    endEdit(1);
+
+    cursorX++;
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+void insertNewLine() {
+    beginEdit(cursorY, 1);
+    std::string newLine = lines[cursorY].substr(cursorX);
+    lines[cursorY].erase(cursorX);
     lines.insert(lines.begin() + cursorY + 1, newLine);
+    endEdit(2);
+
     moveCursorDown();
     cursorX = 0;
     
     updateRenderCursorX();
+}
+
+// Inserts `text` at the cursor as a single edit, however many lines it spans
+void insertText(const char* text, size_t length) {
+    std::vector<size_t> newlines;
+    findNewlines(text, length, newlines);
+
+    std::vector<std::string> inserted;
+    inserted.reserve(newlines.size() + 1);
+    size_t start = 0;
+    for (size_t newline : newlines) {
+        size_t end = newline > start && text[newline - 1] == '\r' ? newline - 1 : newline;
+        inserted.emplace_back(text + start, end - start);
+        start = newline + 1;
+    }
+    inserted.emplace_back(text + start, length - start);
+
+    int count = static_cast<int>(inserted.size());
+    int endX = static_cast<int>(inserted.back().size());
+
+    beginEdit(cursorY, 1);
+    std::string& line = lines[cursorY];
+    inserted.back().append(line, cursorX, std::string::npos);
+    inserted.front().insert(0, line, 0, cursorX);
+    if (count == 1) {
+        endX += cursorX;
+    }
+    line = std::move(inserted.front());
+    lines.insert(lines.begin() + cursorY + 1, std::make_move_iterator(inserted.begin() + 1), std::make_move_iterator(inserted.end()));
+    endEdit(count);
+
+    cursorY += count - 1;
+    cursorX = endX;
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+void paste() {
+    char* text = SDL_GetClipboardText();
+    if (text && *text) {
+        insertText(text, strlen(text));
+    }
+    SDL_free(text);
+}
+
+
+void startSelection() {
+    if (!selectionActive) {
+        selectionActive = true;
+        anchorX = cursorX;
+        anchorY = cursorY;
+    }
+}
+
+void clearSelection() {
+    selectionActive = false;
+}
+
+// Movement keys extend the selection while Shift is held and drop it otherwise
+void prepareSelection(bool extend) {
+    if (extend) {
+        startSelection();
+    } else {
+        clearSelection();
+    }
+}
+
+bool hasSelection() {
+    return selectionActive && (anchorX != cursorX || anchorY != cursorY);
+}
+
+// Selection ends in document order; the anchor is clamped in case an edit shrank the document
+void selectionBounds(int& startX, int& startY, int& endX, int& endY) {
+    anchorY = std::min(anchorY, static_cast<int>(lines.size()) - 1);
+    anchorX = std::min(anchorX, static_cast<int>(lines[anchorY].size()));
+
+    bool anchorFirst = anchorY < cursorY || (anchorY == cursorY && anchorX < cursorX);
+    startX = anchorFirst ? anchorX : cursorX;
+    startY = anchorFirst ? anchorY : cursorY;
+    endX = anchorFirst ? cursorX : anchorX;
+    endY = anchorFirst ? cursorY : anchorY;
+}
+
+// The selected text joined with '\n', built in a single allocation
+std::string selectedText() {
+    int startX, startY, endX, endY;
+    selectionBounds(startX, startY, endX, endY);
+
+    if (startY == endY) {
+        return lines[startY].substr(startX, endX - startX);
+    }
+
+    size_t size = lines[startY].size() - startX + endX + (endY - startY);
+    for (int i = startY + 1; i < endY; i++) {
+        size += lines[i].size();
+    }
+
+    std::string text;
+    text.reserve(size);
+    text.append(lines[startY], startX, std::string::npos);
+    for (int i = startY + 1; i < endY; i++) {
+        text += '\n';
+        text += lines[i];
+    }
+    text += '\n';
+    text.append(lines[endY], 0, endX);
+    return text;
+}
+
+void selectAll() {
+    selectionActive = true;
+    anchorX = 0;
+    anchorY = 0;
+    jumpToFileEnd();
+}
+
+// Copies the selection, or the cursor line when nothing is selected
+void copy() {
+    if (hasSelection()) {
+        SDL_SetClipboardText(selectedText().c_str());
+    } else {
+        SDL_SetClipboardText(lines[cursorY].c_str());
+    }
+}
+
+// Removes the selected range as one edit and leaves the cursor where it started
+bool deleteSelection() {
+    if (!hasSelection()) {
+        clearSelection();
+        return false;
+    }
+
+    int startX, startY, endX, endY;
+    selectionBounds(startX, startY, endX, endY);
+
+    beginEdit(startY, endY - startY + 1);
+    std::string tail = lines[endY].substr(endX);
+    lines[startY].replace(startX, std::string::npos, tail);
+    lines.erase(lines.begin() + startY + 1, lines.begin() + endY + 1);
+    endEdit(1);
+
+    clearSelection();
+    cursorX = startX;
+    cursorY = startY;
+    updateRenderCursorX();
+    scrollToCursor();
+
+    return true;
+}
+
+void cut() {
+    if (hasSelection()) {
+        copy();
+        deleteSelection();
+    }
+}
+
+// Typing over a selection replaces it, and both halves undo together
+void replaceSelection(const std::function<void()>& insert) {
+    beginTransaction();
+    deleteSelection();
+    insert();
+    endTransaction();
+}
+
+bool positionBefore(int x1, int y1, int x2, int y2) {
+    return y1 < y2 || (y1 == y2 && x1 < x2);
+}
+
+void clearExtraCarets() {
+    extraCarets.clear();
+}
+
+// Ctrl+click: the main cursor joins the extra ones and a new one is placed at (x, y)
+void addCaret(int x, int y) {
+    extraCarets.push_back({cursorX, cursorY, anchorX, anchorY, hasSelection()});
+    clearSelection();
+    cursorX = x;
+    cursorY = y;
+    updateRenderCursorX();
+}
+
+// Ctrl+D: selects the word under the cursor, then adds a cursor on each next occurrence of the selection
+void selectNextOccurrence() {
+    if (!hasSelection()) {
+        const std::string& line = lines[cursorY];
+        int start = cursorX;
+        int end = cursorX;
+        while (start > 0 && isWordChar(line[start - 1])) {
+            start--;
+        }
+        while (end < static_cast<int>(line.size()) && isWordChar(line[end])) {
+            end++;
+        }
+        if (start < end) {
+            selectionActive = true;
+            anchorX = start;
+            anchorY = cursorY;
+            cursorX = end;
+            updateRenderCursorX();
+        }
+        return;
+    }
+
+    int startX, startY, endX, endY;
+    selectionBounds(startX, startY, endX, endY);
+    if (startY != endY) {
+        return;
+    }
+    std::string needle = lines[startY].substr(startX, endX - startX);
+
+    // First match after the main selection, wrapping around, that no cursor has selected yet
+    std::vector<std::pair<int, int>> found;
+    int count = static_cast<int>(lines.size());
+    for (int k = 0; k <= count; k++) {
+        int i = (endY + k) % count;
+        found.clear();
+        findAll(lines[i].data(), static_cast<int>(lines[i].size()), needle, found);
+
+        for (const std::pair<int, int>& match : found) {
+            if (k == 0 && match.first < endX) {
+                continue;
+            }
+            bool taken = (i == startY && match.first == startX) || std::any_of(extraCarets.begin(), extraCarets.end(), [&](const Caret& c) {
+                return c.selecting && c.y == i && std::min(c.x, c.anchorX) == match.first;
+            });
+            if (!taken) {
+                addCaret(match.first + match.second, i);
+                selectionActive = true;
+                anchorX = match.first;
+                anchorY = i;
+                scrollToCursor();
+                return;
+            }
+        }
+    }
+}
+
+// Replaces the range of every cursor with `text` as a single edit: the ranges are sorted by offset
+// and only the lines they touch rebuilt, one hunk each, so there is one undo step and one re-layout.
+// `extend` grows empty ranges by one char backwards (-1, Backspace) or forwards (1, Delete).
+void editAtCarets(const char* text, size_t length, int extend) {
+    int lineCount = static_cast<int>(lines.size());
+    std::vector<TextRange> ranges;
+    ranges.reserve(extraCarets.size() + 1);
+
+    Caret mainCaret = {cursorX, cursorY, anchorX, anchorY, selectionActive};
+    for (size_t n = 0; n <= extraCarets.size(); n++) {
+        Caret c = n < extraCarets.size() ? extraCarets[n] : mainCaret;
+        c.y = std::min(c.y, lineCount - 1);
+        c.x = std::min(c.x, static_cast<int>(lines[c.y].size()));
+        c.anchorY = std::min(c.anchorY, lineCount - 1);
+        c.anchorX = std::min(c.anchorX, static_cast<int>(lines[c.anchorY].size()));
+
+        TextRange range = {c.x, c.y, c.x, c.y};
+        if (c.selecting && (c.x != c.anchorX || c.y != c.anchorY)) {
+            bool anchorFirst = positionBefore(c.anchorX, c.anchorY, c.x, c.y);
+            range = anchorFirst ? TextRange{c.anchorX, c.anchorY, c.x, c.y} : TextRange{c.x, c.y, c.anchorX, c.anchorY};
+        }
+        else if (extend < 0 && range.startX > 0) {
+            range.startX--;
+        }
+        else if (extend < 0 && range.startY > 0) {
+            range.startY--;
+            range.startX = static_cast<int>(lines[range.startY].size());
+        }
+        else if (extend > 0 && range.endX < static_cast<int>(lines[range.endY].size())) {
+            range.endX++;
+        }
+        else if (extend > 0 && range.endY < lineCount - 1) {
+            range.endY++;
+            range.endX = 0;
+        }
+        ranges.push_back(range);
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](const TextRange& a, const TextRange& b) {
+        return positionBefore(a.startX, a.startY, b.startX, b.startY);
+    });
+
+    // Overlapping ranges (and cursors sharing a position) collapse into one
+    std::vector<TextRange> merged;
+    for (const TextRange& range : ranges) {
+        const TextRange* previous = merged.size() ? &merged.back() : nullptr;
+        bool same = previous && previous->startX == range.startX && previous->startY == range.startY && previous->endX == range.endX && previous->endY == range.endY;
+        if (previous && (same || positionBefore(range.startX, range.startY, previous->endX, previous->endY))) {
+            if (positionBefore(merged.back().endX, merged.back().endY, range.endX, range.endY)) {
+                merged.back().endX = range.endX;
+                merged.back().endY = range.endY;
+            }
+        } else {
+            merged.push_back(range);
+        }
+    }
+
+    if (length == 0 && std::all_of(merged.begin(), merged.end(), [](const TextRange& r) {
+        return r.startX == r.endX && r.startY == r.endY;
+    })) {
+        return;
+    }
+
+    std::vector<size_t> newlines;
+    findNewlines(text, length, newlines);
+
+    // One hunk per run of ranges sharing lines, with `first` past the hunks before it as applyStep() wants
+    UndoStep step = {{}, cursorX, cursorY};
+    int shift = 0;
+    std::string current;
+    int x = 0;
+    int y = -1;
+    std::vector<Caret> carets;
+    carets.reserve(merged.size());
+
+    auto closeRun = [&]() {
+        EditHunk& hunk = step.hunks.back();
+        current.append(lines[y], x, std::string::npos);
+        hunk.text.push_back(std::move(current));
+        current.clear();
+        hunk.count = y - (hunk.first - shift) + 1;
+        shift += static_cast<int>(hunk.text.size()) - hunk.count;
+    };
+
+    for (const TextRange& range : merged) {
+        if (range.startY != y) {
+            if (y >= 0) {
+                closeRun();
+            }
+            step.hunks.push_back({range.startY + shift, 0, {}});
+            x = 0;
+        }
+        current.append(lines[range.startY], x, range.startX - x);
+
+        std::vector<std::string>& rebuilt = step.hunks.back().text;
+        size_t start = 0;
+        for (size_t newline : newlines) {
+            size_t end = newline > start && text[newline - 1] == '\r' ? newline - 1 : newline;
+            current.append(text + start, end - start);
+            rebuilt.push_back(std::move(current));
+            current.clear();
+            start = newline + 1;
+        }
+        current.append(text + start, length - start);
+
+        int caretX = static_cast<int>(current.size());
+        int caretY = step.hunks.back().first + static_cast<int>(rebuilt.size());
+        carets.push_back({caretX, caretY, caretX, caretY, false});
+
+        x = range.endX;
+        y = range.endY;
+    }
+    closeRun();
+
+    applyStep(step, false);
+    recordStep(std::move(step));
+
+    clearSelection();
+    cursorX = carets.back().x;
+    cursorY = carets.back().y;
+    carets.pop_back();
+    extraCarets = std::move(carets);
+
+    updateRenderCursorX();
+    scrollToCursor();
+}
+
+// Edits and moves while several cursors are active; plain movement falls back to the main cursor alone
+bool handleMultiCursorEvents(SDL_Keycode key) {
+    bool ctrl = SDL_GetModState() & KMOD_CTRL;
+
+    switch (key) {
+        case SDLK_BACKSPACE:
+            editAtCarets("", 0, -1);
+            return true;
+        case SDLK_DELETE:
+            editAtCarets("", 0, 1);
+            return true;
+        case SDLK_RETURN:
+            editAtCarets("\n", 1, 0);
+            return true;
+        case SDLK_TAB:
+            editAtCarets("\t", 1, 0);
+            return true;
+        case SDLK_v:
+            if (ctrl) {
+                char* text = SDL_GetClipboardText();
+                if (text) {
+                    editAtCarets(text, strlen(text), 0);
+                }
+                SDL_free(text);
+                return true;
+            }
+            return false;
+        case SDLK_ESCAPE:
+            clearExtraCarets();
+            return true;
+        case SDLK_UP:
+        case SDLK_DOWN:
+        case SDLK_LEFT:
+        case SDLK_RIGHT:
+        case SDLK_HOME:
+        case SDLK_END:
+        case SDLK_PAGEUP:
+        case SDLK_PAGEDOWN:
+            clearExtraCarets();
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool deleteCurrentLine() {
+    bool deleted = false;
+
+    if (cursorX == 0 && cursorY > 0) {
+        int previous = cursorY - 1;
+        int joint = static_cast<int>(lines[previous].size());
+
+        beginEdit(previous, 2);
+        lines[previous].append(lines[cursorY]);
+        lines.erase(lines.begin() + cursorY);
+        endEdit(1);
+
+        cursorY = previous;
+        cursorX = joint;
+        updateRenderCursorX();
+        scrollToCursor();
+
+        deleted = true;
+    }
+
+    return deleted;
+}
+
+bool deleteNextLine() {
+    bool deleted = false;
+
+    if (cursorX == static_cast<int>(lines[cursorY].size()) &&
+        cursorY < static_cast<int>(lines.size() - 1)
+    ) {
+        beginEdit(cursorY, 2);
+        lines[cursorY].append(lines[cursorY + 1]);
+        lines.erase(lines.begin() + cursorY + 1);
+        endEdit(1);
+
+        updateRenderCursorX();
+
+        deleted = true;
+    }
+
+    return deleted;
+}
+
+void undo() {
+    if (undoHistory.empty()) {
+        return;
+    }
+
+    UndoStep step = std::move(undoHistory.back());
+    undoHistory.pop_back();
+    typingStepOpen = false;
+    applyStep(step, true);
+    clearSelection();
+    clearExtraCarets();
+
+    cursorY = std::min(step.cursorY, static_cast<int>(lines.size()) - 1);
+    cursorX = std::min(step.cursorX, static_cast<int>(lines[cursorY].size()));
+    updateRenderCursorX();
+    scrollToCursor();
+
+    redoHistory.push_back(std::move(step));
+}
+
+void redo() {
+    if (redoHistory.empty()) {
+        return;
+    }
+
+    UndoStep step = std::move(redoHistory.back());
+    redoHistory.pop_back();
+    applyStep(step, false);
+    clearSelection();
+    clearExtraCarets();
+
+    const EditHunk& last = step.hunks.back();
+    cursorY = std::min(last.first + std::max(0, last.count - 1), static_cast<int>(lines.size()) - 1);
+    cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+    updateRenderCursorX();
+    scrollToCursor();
+
+    undoHistory.push_back(std::move(step));
+}
+
+void openSearch(bool replace) {
+    searchActive = true;
+    replaceActive = replace;
+    replaceFocused = false;
+    startSearch();
+}
+
+void closeSearch() {
+    searchActive = false;
+    stopSearch();
+}
+
+// Moves the cursor to the next (or previous) match found so far, wrapping around the document
+void jumpToSearchMatch(bool backwards) {
+    if (searchMatchCount == 0) {
+        return;
+    }
+
+    int chunkCount = static_cast<int>(searchChunks.size());
+    int startChunk = cursorY / SEARCH_CHUNK_LINES;
+    const SearchMatch* target = nullptr;
+
+    for (int k = 0; k <= chunkCount && !target; k++) {
+        int chunk = backwards ? (startChunk - k % chunkCount + chunkCount) % chunkCount : (startChunk + k) % chunkCount;
+        const std::vector<SearchMatch>& matches = searchChunks[chunk];
+
+        for (int n = 0; n < static_cast<int>(matches.size()) && !target; n++) {
+            const SearchMatch& m = matches[backwards ? matches.size() - 1 - n : n];
+            bool after = m.line > cursorY || (m.line == cursorY && m.column > cursorX);
+            bool before = m.line < cursorY || (m.line == cursorY && m.column < cursorX);
+            if (k > 0 || (backwards ? before : after)) {
+                target = &m;
+            }
+        }
+    }
+
+    if (target) {
+        cursorY = target->line;
+        cursorX = target->column;
+        updateRenderCursorX();
+        scrollToCursor();
+    }
+}
+
+bool handleSearchEvents(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_ESCAPE:
+            closeSearch();
+            return true;
+        case SDLK_BACKSPACE:
+            if (replaceFocused && replaceQuery.size()) {
+                replaceQuery.pop_back();
+            }
+            else if (!replaceFocused && searchQuery.size()) {
+                searchQuery.pop_back();
+                startSearch();
+            }
+            return true;
+        case SDLK_TAB:
+            replaceFocused = replaceActive && !replaceFocused;
+            return true;
+        case SDLK_RETURN:
+            if (replaceActive && (SDL_GetModState() & KMOD_CTRL)) {
+                replaceAll();
+            } else {
+                jumpToSearchMatch(SDL_GetModState() & KMOD_SHIFT);
+            }
+            return true;
+        case SDLK_r:
+            if (SDL_GetModState() & KMOD_CTRL) {
+                searchRegexMode = !searchRegexMode;
+                startSearch();
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+#pragma region LOAD
+// Files are shown as soon as their first LOAD_FIRST_LINES lines are read: a pool task reads
+// the rest in LOAD_CHUNK_LINES batches, appended at the end of the document once per frame.
+std::atomic<unsigned> loadGeneration(0);
+std::atomic<bool> loadRunning(false);
+std::mutex loadedLinesMutex;
+std::condition_variable loadedLinesReady;   // a chunk was read, or the reader is done
+std::vector<std::string> loadedLines;
+bool loadPending = false;   // the document is not complete yet
+int loadTargetLine = -1;    // where to put the cursor once that line has arrived
+
+void readRemainingLines(std::shared_ptr<std::ifstream> in, unsigned generation) {
+    std::vector<std::string> chunk;
+    std::string line;
+    bool reading = true;
+    while (reading && generation == loadGeneration) {
+        chunk.clear();
+        while ((reading = static_cast<bool>(std::getline(*in, line))) && static_cast<int>(chunk.size()) < LOAD_CHUNK_LINES - 1) {
+            chunk.push_back(std::move(line));
+        }
+        if (reading) {
+            chunk.push_back(std::move(line));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(loadedLinesMutex);
+            if (generation != loadGeneration) {
+                return;     // stopped, a newer load may be running already
+            }
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(loadedLines));
+        }
+        loadedLinesReady.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(loadedLinesMutex);
+        if (generation == loadGeneration) {
+            loadRunning = false;
+        }
+    }
+    loadedLinesReady.notify_one();
+}
+
+void startLoading(std::shared_ptr<std::ifstream> in) {
+    loadPending = true;
+    loadRunning = true;
+    unsigned generation = loadGeneration;
+    pool->submit([in, generation] { readRemainingLines(in, generation); });
+}
+
+// The reader task finds out on its own, what it reads past this point is dropped
+void stopLoading() {
+    std::lock_guard<std::mutex> lock(loadedLinesMutex);
+    loadGeneration++;
+    loadRunning = false;
+    loadedLines.clear();
+    loadPending = false;
+    loadTargetLine = -1;
+}
+
+bool loading() {
+    return loadPending;
+}
+
+// Called every frame: appends what the loader read since, as a single edit
+void applyLoadedLines() {
+    bool finished = !loadRunning;
+    std::vector<std::string> chunk;
+    {
+        std::lock_guard<std::mutex> lock(loadedLinesMutex);
+        chunk.swap(loadedLines);
+    }
+
+    if (chunk.size()) {
+        int first = static_cast<int>(lines.size());
+        beginEdit(first, 0, false);
+        lines.insert(lines.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+        endEdit(static_cast<int>(chunk.size()));
+    }
+
+    if (finished) {
+        loadPending = false;
+    }
+
+    if (loadTargetLine >= 0 && (finished || loadTargetLine < static_cast<int>(lines.size()))) {
+        cursorY = std::min(loadTargetLine, static_cast<int>(lines.size()) - 1);
+        cursorX = 0;
+        loadTargetLine = -1;
+        updateRenderCursorX();
+        scrollToCursor();
+    }
+}
+#pragma endregion
+
+
+#pragma region FOLLOW
+// Tail mode (Ctrl+T): the open file is watched with inotify and only the bytes appended since the
+// last read are taken in, by extending the viewer index or by appending to `lines`.
+// The view sticks to the end of the file as long as it was showing the end.
+bool following = false;
+long long followLastCount = 0;      // viewer lines at the previous frame
+off_t followOffset = 0;             // bytes of the file already in `lines`
+ino_t followInode = 0;
+bool followTrailingNewline = false;
+
+int watchFile = -1;
+int watchDescriptor = -1;
+std::string watchedPath;
+
+bool startWatch(const std::string& path) {
+    if (watchFile < 0) {
+        watchFile = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    watchedPath = path;
+    watchDescriptor = watchFile < 0 ? -1 : inotify_add_watch(watchFile, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    return watchDescriptor >= 0;
+}
+
+void stopWatch() {
+    if (watchDescriptor >= 0) {
+        inotify_rm_watch(watchFile, watchDescriptor);
+    }
+    watchDescriptor = -1;
+    watchedPath.clear();
+}
+
+// Drains pending inotify events, true if the watched file changed.
+// A file moved or deleted (log rotation) is watched again once its path exists anew.
+bool pollWatch() {
+    if (watchFile < 0 || watchedPath.empty()) {
+        return false;
+    }
+
+    bool changed = false;
+    bool replaced = watchDescriptor < 0;
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t n;
+    while ((n = read(watchFile, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            if (event->wd == watchDescriptor) {
+                changed |= (event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) != 0;
+                replaced |= (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) != 0;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (replaced) {
+        if (watchDescriptor >= 0) {
+            inotify_rm_watch(watchFile, watchDescriptor);
+        }
+        watchDescriptor = inotify_add_watch(watchFile, watchedPath.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        changed |= watchDescriptor >= 0;
+    }
+    return changed;
+}
+
+void stopFollowing() {
+    following = false;
+    stopWatch();
+}
+
+// Maps the grown file and indexes only the new bytes, the index task scanning the previous
+// mapping giving way to the new one; a truncated or replaced file is reopened
+void followViewer() {
+    struct stat opened;
+    struct stat current;
+    if (fstat(viewerFile, &opened) != 0 || stat(viewerPath.c_str(), &current) != 0) {
+        return;
+    }
+
+    if (current.st_ino != opened.st_ino || static_cast<size_t>(current.st_size) < viewerSize) {
+        bool pinned = viewerTop >= followLastCount - viewerVisibleRows();
+        std::string path = viewerPath;
+        closeViewer();
+        if (!openViewer(path)) {
+            stopFollowing();
+        }
+        followLastCount = pinned ? 0 : followLastCount;
+        return;
+    }
+    if (static_cast<size_t>(current.st_size) == viewerSize) {
+        return;
+    }
+
+    void* data = mmap(nullptr, current.st_size, PROT_READ, MAP_SHARED, viewerFile, 0);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    viewerMapping = std::make_shared<ViewerMapping>(data, current.st_size);
+    viewerData = viewerMapping->data;
+    viewerSize = viewerMapping->size;
+    startViewerIndex();
+}
+
+// Appends the new bytes of the file to the document as one edit
+void followEditor() {
+    int file = open(documentPath.c_str(), O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+        if (file >= 0) {
+            close(file);
+        }
+        return;
+    }
+
+    // Truncated or rotated: follow the new content from its start
+    if (info.st_ino != followInode || info.st_size < followOffset) {
+        beginEdit(0, static_cast<int>(lines.size()), false);
+        lines.assign(1, "");
+        endEdit(1);
+        cursorX = 0;
+        cursorY = 0;
+        followInode = info.st_ino;
+        followOffset = 0;
+        followTrailingNewline = false;
+    }
+
+    std::string text(followTrailingNewline ? "\n" : "");
+    size_t prefix = text.size();
+    text.resize(prefix + (info.st_size - followOffset));
+    ssize_t n = 0;
+    for (size_t read = prefix; read < text.size(); read += n) {
+        n = pread(file, &text[read], text.size() - read, followOffset + (read - prefix));
+        if (n <= 0) {
+            text.resize(read);
+            break;
+        }
+    }
+    close(file);
+
+    followOffset += text.size() - prefix;
+    if (text.size() > prefix) {
+        followTrailingNewline = text.back() == '\n';
+        documentFinalNewline = followTrailingNewline;
+        if (followTrailingNewline) {
+            text.pop_back();
+        }
+    }
+    if (text.empty()) {
+        return;
+    }
+
+    bool pinned = cursorY == static_cast<int>(lines.size()) - 1;
+    int x = cursorX;
+    int y = cursorY;
+    bool selecting = selectionActive;
+    cursorY = static_cast<int>(lines.size()) - 1;
+    cursorX = static_cast<int>(lines[cursorY].size());
+    clearSelection();
+
+    insertText(text.data(), text.size());
+
+    if (!pinned) {
+        cursorX = x;
+        cursorY = y;
+        selectionActive = selecting;
+        updateRenderCursorX();
+    }
+}
+
+void toggleFollow() {
+    if (following) {
+        stopFollowing();
+        return;
+    }
+    if (loading()) {
+        return;
+    }
+
+    std::string path = viewerMode ? viewerPath : documentPath;
+    struct stat info;
+    if (path.empty() || stat(path.c_str(), &info) != 0 || !startWatch(path)) {
+        return;
+    }
+    following = true;
+
+    if (viewerMode) {
+        followLastCount = viewerLineCount();
+        followViewer();
+        return;
+    }
+
+    // The document holds the file as it was loaded, nothing before its current end is read again
+    followTrailingNewline = fileEndsWithNewline(path);
+    followOffset = info.st_size;
+    followInode = info.st_ino;
+}
+
+// Called every frame
+void updateFollow() {
+    if (!following) {
+        return;
+    }
+
+    if (pollWatch()) {
+        if (viewerMode) {
+            followViewer();
+        } else {
+            followEditor();
+        }
+    }
+
+    if (viewerMode) {
+        long long count = viewerLineCount();
+        if (viewerTop >= followLastCount - viewerVisibleRows()) {
+            viewerTop = std::max(0LL, count - viewerVisibleRows());
+        }
+        followLastCount = count;
+    }
+}
+#pragma endregion
+
+
+#pragma region DIALOG
+// The native dialogs are separate processes (zenity, kdialog...) that block until the user answers,
+// so they run on their own thread and the answer comes back to the loop as a dialogEvent.
+// Save and Open pick a path, the others are yes / no questions about `subject`.
+enum dialogs { DIALOG_SAVE, DIALOG_OPEN, DIALOG_RELOAD, DIALOG_OVERWRITE, DIALOG_CLOSE_TAB };
+
+std::atomic<bool> dialogOpen(false);    // until the main thread takes the answer
+std::mutex dialogMutex;
+bool dialogsClosed = false;             // set before SDL_Quit, a late answer is dropped then
+
+std::string dialogQuestion(int dialog, const std::string& subject) {
+    switch (dialog) {
+        case DIALOG_RELOAD:
+            return subject + " changed on disk. Reload it and lose the unsaved changes ?";
+        case DIALOG_OVERWRITE:
+            return subject + " already exists. Replace it ?";
+        default:
+            return "Close this tab ? Its unsaved changes will be lost.";
+    }
+}
+
+// Shows the dialog unless one is already open, false then. The answer is delivered in data1:
+// the path chosen, or `subject` when a question is answered yes, nullptr otherwise
+bool requestDialog(int dialog, const std::string& subject = "") {
+    if (dialogOpen.exchange(true)) {
+        return false;
+    }
+
+    std::thread([dialog, subject] {
+        char const * filterPatterns[2] = { "*.txt", "*.text" };
+        std::string* answer = nullptr;
+        if (dialog == DIALOG_SAVE || dialog == DIALOG_OPEN) {
+            char* path = dialog == DIALOG_SAVE
+                ? tinyfd_saveFileDialog("Save", "./Output/unknow.txt", 2, filterPatterns, NULL)
+                : tinyfd_openFileDialog("Open", "Output/unknow.txt", 2, filterPatterns, NULL, 0);
+            answer = path != NULL ? new std::string(path) : nullptr;
+        }
+        else if (tinyfd_messageBox("Ogmios", dialogQuestion(dialog, subject).c_str(), "yesno", "question", 0)) {
+            answer = new std::string(subject);
+        }
+
+        SDL_Event event;
+        memset(&event, 0, sizeof(event));
+        event.type = dialogEvent;
+        event.user.code = dialog;
+        event.user.data1 = answer;
+        std::lock_guard<std::mutex> lock(dialogMutex);
+        if (dialogsClosed || SDL_PushEvent(&event) <= 0) {
+            delete answer;
+            dialogOpen = false;
+        }
+    }).detach();
+    return true;
+}
+
+// A dialog still open keeps its thread blocked; once this returns its answer never reaches SDL
+void closeDialogs() {
+    std::lock_guard<std::mutex> lock(dialogMutex);
+    dialogsClosed = true;
+}
+#pragma endregion
+
+
+#pragma region RELOAD
+// A file changed on disk under the open document is diffed against it on the pool and only the
+// differing line ranges are swapped in, as one undo step, keeping history, cursor and caches.
+// Line hashes let the common prefix and suffix be skipped quickly; what lies between is
+// aligned with Myers' diff up to RELOAD_DIFF_EDITS_MAX edits, beyond that it is replaced whole.
+struct ReloadResult {
+    unsigned version;
+    std::vector<EditHunk> hunks;    // in application order, `first` already shifted by the hunks before
+    bool finalNewline;
+};
+
+struct timespec documentMtime = {0, 0};
+off_t documentSize = -1;
+bool reloadNeeded = false;
+bool reloadConflict = false;    // the file changed under unsaved edits, the user is to be asked
+bool reloadDiscarding = false;  // they agreed, the next reload replaces the edits
+std::atomic<bool> reloadRunning(false);
+std::mutex reloadResultMutex;
+std::vector<ReloadResult> reloadResults;
+
+// The file as we last read or wrote it, so our own saves are not taken for external changes
+void recordDocumentStat() {
+    struct stat info;
+    if (documentPath.size() && stat(documentPath.c_str(), &info) == 0) {
+        documentMtime = info.st_mtim;
+        documentSize = info.st_size;
+    } else {
+        documentSize = -1;
+    }
+}
+
+uint64_t hashLine(const std::string& line) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : line) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Matching line pairs of old[a, a + n) and new[b, b + m), false when there are more than `limit` edits
+// or the document moves past `version`, an edit then waiting for the lock this runs under
+bool diffLines(const std::vector<uint64_t>& oldHashes, const std::vector<uint64_t>& newHashes, const std::vector<std::string>& newLines,
+               int a, int n, int b, int m, int limit, unsigned version, std::vector<std::pair<int, int>>& matches) {
+    auto equal = [&](int x, int y) {
+        return oldHashes[a + x] == newHashes[b + y] && lines[a + x] == newLines[b + y];
+    };
+
+    int max = std::min(n + m, limit);
+    std::vector<int> v(2 * max + 2, 0);
+    std::vector<std::vector<int>> trace;
+    int d = 0;
+    for (bool done = false; !done; d++) {
+        if (d > max || documentVersion != version) {
+            return false;
+        }
+        trace.push_back(v);
+        for (int k = -d; k <= d && !done && documentVersion == version; k += 2) {
+            int x = (k == -d || (k != d && v[max + k - 1] < v[max + k + 1])) ? v[max + k + 1] : v[max + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && equal(x, y)) {
+                x++;
+                y++;
+            }
+            v[max + k] = x;
+            done = x >= n && y >= m;
+        }
+    }
+
+    // Walk the snakes back from the end
+    int x = n;
+    int y = m;
+    for (d = static_cast<int>(trace.size()) - 1; d >= 0; d--) {
+        const std::vector<int>& previous = trace[d];
+        int k = x - y;
+        int previousK = (k == -d || (k != d && previous[max + k - 1] < previous[max + k + 1])) ? k + 1 : k - 1;
+        int previousX = d == 0 ? 0 : previous[max + previousK];
+        int previousY = d == 0 ? 0 : previousX - previousK;
+        while (x > previousX && y > previousY) {
+            matches.emplace_back(a + --x, b + --y);
+        }
+        x = previousX;
+        y = previousY;
+    }
+    std::reverse(matches.begin(), matches.end());
+    return true;
+}
+
+// Runs on the pool: reads the file and diffs it against `lines`, unless an edit comes first
+void reloadDocument(std::string path, unsigned version) {
+    std::vector<std::string> newLines;
+    bool finalNewline;
+    bool read = readDocument(path, newLines, finalNewline);
+
+    std::vector<uint64_t> newHashes(newLines.size());
+    for (size_t i = 0; i < newLines.size(); i++) {
+        newHashes[i] = hashLine(newLines[i]);
+    }
+
+    // A result computed against a document edited meanwhile is still delivered, so the reload is retried.
+    // Every loop under the lock gives up as soon as an edit bumps the version and waits for it.
+    ReloadResult result = {version, {}, finalNewline};
+    if (read) {
+        std::shared_lock<std::shared_mutex> lock(documentMutex);
+        int oldCount = static_cast<int>(lines.size());
+        int newCount = static_cast<int>(newLines.size());
+
+        std::vector<uint64_t> oldHashes(oldCount);
+        for (int i = 0; i < oldCount && documentVersion == version; i++) {
+            oldHashes[i] = hashLine(lines[i]);
+        }
+
+        int prefix = 0;
+        while (prefix < oldCount && prefix < newCount && documentVersion == version &&
+               oldHashes[prefix] == newHashes[prefix] && lines[prefix] == newLines[prefix]) {
+            prefix++;
+        }
+        int suffix = 0;
+        while (suffix < oldCount - prefix && suffix < newCount - prefix && documentVersion == version &&
+               oldHashes[oldCount - 1 - suffix] == newHashes[newCount - 1 - suffix] && lines[oldCount - 1 - suffix] == newLines[newCount - 1 - suffix]) {
+            suffix++;
+        }
+
+        int n = oldCount - prefix - suffix;
+        int m = newCount - prefix - suffix;
+        std::vector<std::pair<int, int>> matches;
+        if (documentVersion == version && (n || m) && !diffLines(oldHashes, newHashes, newLines, prefix, n, prefix, m, RELOAD_DIFF_EDITS_MAX, version, matches)) {
+            matches.clear();
+        }
+        if (documentVersion != version) {
+            matches.clear();
+        } else {
+            matches.emplace_back(prefix + n, prefix + m);
+        }
+
+        // Every gap between two matched lines is a hunk
+        int oldNext = prefix;
+        int newNext = prefix;
+        for (const std::pair<int, int>& match : matches) {
+            if (match.first > oldNext || match.second > newNext) {
+                EditHunk hunk = {newNext, match.first - oldNext, {}};
+                hunk.text.assign(std::make_move_iterator(newLines.begin() + newNext), std::make_move_iterator(newLines.begin() + match.second));
+                result.hunks.push_back(std::move(hunk));
+            }
+            oldNext = match.first + 1;
+            newNext = match.second + 1;
+        }
+    }
+
+    if (read) {
+        std::lock_guard<std::mutex> lock(reloadResultMutex);
+        reloadResults.push_back(std::move(result));
+    }
+    reloadRunning = false;
+}
+
+void startReload() {
+    reloadNeeded = false;
+    reloadRunning = true;
+    std::string path = documentPath;
+    unsigned version = documentVersion;
+    pool->submit([path, version] { reloadDocument(path, version); });
+}
+
+// Swaps the differing ranges in as a single step, the cursor keeps its place relative to the text around it
+void applyReloadResults() {
+    std::vector<ReloadResult> results;
+    {
+        std::lock_guard<std::mutex> lock(reloadResultMutex);
+        results.swap(reloadResults);
+    }
+
+    for (ReloadResult& result : results) {
+        if (result.version != documentVersion) {
+            reloadNeeded = true;
+            continue;
+        }
+        // Edits made since the reload started are only dropped once the user agreed to
+        if (documentEdited && !reloadDiscarding) {
+            reloadConflict = true;
+            continue;
+        }
+        reloadDiscarding = false;
+        documentFinalNewline = result.finalNewline;
+        if (result.hunks.empty()) {
+            if (documentEdited) {
+                journalReset(documentPath);
+            }
+            continue;
+        }
+
+        UndoStep step = {std::move(result.hunks), cursorX, cursorY};
+        int shift = 0;
+        for (const EditHunk& hunk : step.hunks) {
+            if (hunk.first + hunk.count - shift <= cursorY) {
+                shift += static_cast<int>(hunk.text.size()) - hunk.count;
+            }
+        }
+
+        applyStep(step, false);
+        recordStep(std::move(step));
+        journalReset(documentPath);
+
+        clearSelection();
+        clearExtraCarets();
+        cursorY = std::max(0, std::min(cursorY + shift, static_cast<int>(lines.size()) - 1));
+        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+        updateRenderCursorX();
+    }
+}
+
+// Called every frame: watches the open file while it is not being followed
+void updateExternalChanges() {
+    if (following || viewerMode || loading() || documentPath.empty()) {
+        return;
+    }
+    if (watchedPath != documentPath) {
+        stopWatch();
+        startWatch(documentPath);
+        reloadConflict = false;
+        reloadDiscarding = false;
+    }
+
+    if (pollWatch()) {
+        struct stat info;
+        if (stat(documentPath.c_str(), &info) == 0 && (info.st_size != documentSize ||
+            info.st_mtim.tv_sec != documentMtime.tv_sec || info.st_mtim.tv_nsec != documentMtime.tv_nsec)) {
+            documentMtime = info.st_mtim;
+            documentSize = info.st_size;
+            if (documentEdited) {
+                reloadConflict = true;
+            } else {
+                reloadNeeded = true;
+            }
+        }
+    }
+
+    // Asked as soon as no other dialog is open, the edits stay until the answer
+    if (reloadConflict && requestDialog(DIALOG_RELOAD, documentPath)) {
+        reloadConflict = false;
+    }
+
+    applyReloadResults();
+    if (reloadNeeded && !reloadRunning) {
+        startReload();
+    }
+}
+#pragma endregion
+
+
+void clearEditor() {
+    stopLoading();
+    stopFollowing();
+    closeViewer();
+
+    beginEdit(0, static_cast<int>(lines.size()), false);
+    lines.clear();
+    lines.push_back("");
+    endEdit(1);
+    setLexerFor("");
+    documentPath.clear();
+    documentFinalNewline = true;
+    journalReset(documentPath);
+
+    clearSelection();
+    clearExtraCarets();
+    jumpToFileStart();
+}
+
+
+#pragma region TABS
+// Every open document has a tab. Only the active one lives in `lines` and the caches built on it
+// (layout, highlights, search): the others keep their text joined in a single string, with their
+// cursor and history, and get split and laid out again when they are shown.
+unsigned bufferIds = 0;
+
+struct Buffer {
+    unsigned id = bufferIds++;      // names the tab in dialog answers, whatever its position by then
+    std::string text;               // the lines joined by '\n' while inactive
+    std::string path;
+    bool finalNewline = true;
+    bool edited = false;            // differs from the file at `path`
+    int baseLines = 1;              // lines of that file, which the journal starts again from
+    bool viewer = false;            // shown in the read-only viewer
+    int cursorX = 0;
+    int cursorY = 0;
+    int scrollPosition = 0;
+    std::deque<UndoStep> undoHistory;
+    std::vector<UndoStep> redoHistory;
+    struct timespec mtime = {0, 0};
+    off_t size = -1;
+};
+
+std::vector<Buffer> buffers(1);
+int activeBuffer = 0;
+std::vector<SDL_Rect> tabBoxes;     // where each tab was drawn, for clicks
+
+// Waits for a progressive load, a tab must hold the whole document before it is put away
+void finishLoading() {
+    while (loading()) {
+        {
+            std::unique_lock<std::mutex> lock(loadedLinesMutex);
+            loadedLinesReady.wait(lock, [] { return loadedLines.size() || !loadRunning; });
+        }
+        applyLoadedLines();
+    }
+}
+
+// Moves the active document out of the editor state into its tab
+void parkBuffer() {
+    finishLoading();
+    stopFollowing();
+    stopSearch();
+
+    Buffer& buffer = buffers[activeBuffer];
+    buffer.viewer = viewerMode;
+    buffer.path = viewerMode ? viewerPath : documentPath;
+    buffer.finalNewline = documentFinalNewline;
+    buffer.edited = documentEdited;
+    buffer.baseLines = static_cast<int>(lines.size()) - documentLineDelta;
+    closeViewer();
+
+    size_t size = lines.size();
+    for (const std::string& line : lines) {
+        size += line.size();
+    }
+    buffer.text.clear();
+    buffer.text.reserve(size);
+    for (size_t i = 0; i < lines.size(); i++) {
+        buffer.text += lines[i];
+        if (i + 1 < lines.size()) {
+            buffer.text += '\n';
+        }
+    }
+
+    buffer.cursorX = cursorX;
+    buffer.cursorY = cursorY;
+    buffer.scrollPosition = scrollPosition;
+    buffer.undoHistory = std::move(undoHistory);
+    buffer.redoHistory = std::move(redoHistory);
+    buffer.mtime = documentMtime;
+    buffer.size = documentSize;
+}
+
+// Brings tab `k` into the editor state, whatever was there is dropped
+void showBuffer(int k) {
+    activeBuffer = k;
+    Buffer& buffer = buffers[k];
+
+    if (buffer.viewer) {
+        clearEditor();
+        if (!openViewer(buffer.path)) {
+            tinyfd_messageBox("Ogmios", "Cannot map the file !", "ok", "error", 1);
+        }
+        return;
+    }
+
+    stopLoading();
+    stopFollowing();
+    closeViewer();
+
+    std::vector<size_t> newlines;
+    findNewlines(buffer.text.data(), buffer.text.size(), newlines);
+    beginEdit(0, static_cast<int>(lines.size()), false);
+    lines.clear();
+    lines.reserve(newlines.size() + 1);
+    size_t start = 0;
+    for (size_t newline : newlines) {
+        lines.emplace_back(buffer.text, start, newline - start);
+        start = newline + 1;
+    }
+    lines.emplace_back(buffer.text, start, std::string::npos);
+    endEdit(static_cast<int>(lines.size()));
+    std::string().swap(buffer.text);
+
+    undoHistory = std::move(buffer.undoHistory);
+    redoHistory = std::move(buffer.redoHistory);
+    setLexerFor(buffer.path);
+    documentPath = buffer.path;
+    documentFinalNewline = buffer.finalNewline;
+    // The file may have changed meanwhile, comparing with the old stat lets the reload catch it
+    documentMtime = buffer.mtime;
+    documentSize = buffer.size;
+
+    // The journal only follows the active tab, it starts over from the file on disk with the
+    // parked lines replacing all of it
+    journalReset(documentPath);
+    if (buffer.edited) {
+        journalSplice(0, buffer.baseLines, static_cast<int>(lines.size()));
+    }
+
+    clearSelection();
+    clearExtraCarets();
+    cursorY = std::min(buffer.cursorY, static_cast<int>(lines.size()) - 1);
+    cursorX = std::min(buffer.cursorX, static_cast<int>(lines[cursorY].size()));
+    updateRenderCursorY();
+    updateRenderCursorX();
+    scrollPosition = 0;
+    scroll(buffer.scrollPosition);
+
+    if (searchActive) {
+        startSearch();
+    }
+}
+
+void switchBuffer(int k) {
+    if (k == activeBuffer || k < 0 || k >= static_cast<int>(buffers.size())) {
+        return;
+    }
+    parkBuffer();
+    showBuffer(k);
+}
+
+void newBuffer() {
+    parkBuffer();
+    buffers.push_back(Buffer());
+    showBuffer(static_cast<int>(buffers.size()) - 1);
+}
+
+// True when the active tab holds something, opening a file then takes a new tab
+bool bufferInUse() {
+    return viewerMode || documentPath.size() || lines.size() > 1 || lines[0].size() || undoHistory.size();
+}
+
+// Tab already showing the file at `path`, -1 if none
+int findBuffer(const std::string& path) {
+    struct stat wanted, info;
+    if (stat(path.c_str(), &wanted) != 0) {
+        return -1;
+    }
+    for (int k = 0; k < static_cast<int>(buffers.size()); k++) {
+        const std::string& open = k == activeBuffer ? (viewerMode ? viewerPath : documentPath) : buffers[k].path;
+        if (open.size() && stat(open.c_str(), &info) == 0 && info.st_dev == wanted.st_dev && info.st_ino == wanted.st_ino) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// Drops tab `k` and whatever it holds
+void removeBuffer(int k) {
+    if (k != activeBuffer) {
+        buffers.erase(buffers.begin() + k);
+        activeBuffer -= k < activeBuffer;
+        return;
+    }
+
+    buffers.erase(buffers.begin() + activeBuffer);
+    if (buffers.empty()) {
+        buffers.push_back(Buffer());
+    }
+    showBuffer(std::min(activeBuffer, static_cast<int>(buffers.size()) - 1));
+}
+
+// A tab with unsaved changes is only closed once the user agreed, see handleDialogEvent()
+void closeBuffer() {
+    if (documentEdited) {
+        requestDialog(DIALOG_CLOSE_TAB, std::to_string(buffers[activeBuffer].id));
+    } else {
+        removeBuffer(activeBuffer);
+    }
+}
+
+std::string bufferName(int k) {
+    const std::string& path = k == activeBuffer ? (viewerMode ? viewerPath : documentPath) : buffers[k].path;
+    if (path.empty()) {
+        return "untitled";
+    }
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int tabAt(const SDL_Point& point) {
+    for (int k = 0; k < static_cast<int>(tabBoxes.size()); k++) {
+        if (SDL_PointInRect(&point, &tabBoxes[k])) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+bool handleTabEvents(SDL_Keycode key) {
+    if (!(SDL_GetModState() & KMOD_CTRL)) {
+        return false;
+    }
+
+    int count = static_cast<int>(buffers.size());
+    switch (key) {
+        case SDLK_n:                // NEW TAB
+            newBuffer();
+            return true;
+        case SDLK_w:                // CLOSE TAB
+            closeBuffer();
+            return true;
+        case SDLK_TAB:              // NEXT / PREVIOUS TAB
+            switchBuffer((activeBuffer + (SDL_GetModState() & KMOD_SHIFT ? count - 1 : 1)) % count);
+            return true;
+        case SDLK_PAGEUP:
+            switchBuffer((activeBuffer + count - 1) % count);
+            return true;
+        case SDLK_PAGEDOWN:
+            switchBuffer((activeBuffer + 1) % count);
+            return true;
+        default:
+            return false;
+    }
+}
+#pragma endregion
+
+
+bool writeDocument(const std::string& path) {
+    std::ofstream out(path);
+    for (size_t i = 0; i < lines.size(); i++) {
+        out << lines[i];
+        if (i + 1 < lines.size() || documentFinalNewline) {
+            out << '\n';
+        }
+    }
+    out.close();
+    return static_cast<bool>(out);
+}
+
+void saveTo(const char* path) {
+    if (path != NULL && loading()) {
+        tinyfd_messageBox("Ogmios", "The file is still loading !", "ok", "warning", 1);
+    }
+    else if (path != NULL && writeDocument(path)) {
+        documentPath = path;
+        recordDocumentStat();
+        journalReset(documentPath);
+    } else {
+        tinyfd_messageBox("Ogmios", "Cannot save the file !", "ok", "error", 1);
+    }
+}
+
+// Restores the unsaved edits of a session that did not exit cleanly.
+// Returns the length of the journal prefix that replayed, so the new session can append to it.
+off_t recoverJournal() {
+    std::ifstream in(JOURNAL_PATH, std::ios::binary);
+    std::string journal((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::vector<std::string> document;
+    std::string path;
+    bool finalNewline = true;
+    bool edited = false;
+    size_t offset = replayJournal(journal.data(), journal.size(), true, document, path, finalNewline, edited);
+
+    if (offset == 0) {
+        return 0;
+    }
+
+    beginEdit(0, static_cast<int>(lines.size()), false);
+    lines = std::move(document);
+    endEdit(static_cast<int>(lines.size()));
+    setLexerFor(path);
+    documentPath = path;
+    documentFinalNewline = finalNewline;
+    documentEdited = edited;
+    std::vector<std::string> base(1);    // what the edits replayed were made to
+    if (edited && path.size()) {
+        readDocument(path, base, finalNewline);
+    }
+    documentLineDelta = edited ? static_cast<int>(lines.size() - base.size()) : 0;
+    recordDocumentStat();
+
+    clearSelection();
+    clearExtraCarets();
+    jumpToFileStart();
+
+    std::cout << "Recovered unsaved changes" << (path.size() ? " to " + path : "") << std::endl;
+
+    return offset;
+}
+
+// Opens `path` with the cursor on `line` (0-based, INT_MAX for the last one)
+void openFile(const std::string& path, int line) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        tinyfd_messageBox("Ogmios", "Cannot open the file !", "ok", "error", 1);
+        return;
+    }
+
+    int open = findBuffer(path);
+    if (open >= 0 && open != activeBuffer) {
+        switchBuffer(open);
+        if (!viewerMode) {
+            cursorY = std::min(line, static_cast<int>(lines.size()) - 1);
+            cursorX = 0;
+            updateRenderCursorY();
+            updateRenderCursorX();
+            scrollToCursor();
+        }
+        return;
+    }
+    if (open < 0 && bufferInUse()) {
+        parkBuffer();
+        buffers.push_back(Buffer());
+        activeBuffer = static_cast<int>(buffers.size()) - 1;
+    }
+
+    if (static_cast<size_t>(info.st_size) >= viewerThreshold) {
+        clearEditor();
+        if (!openViewer(path)) {
+            tinyfd_messageBox("Ogmios", "Cannot map the file !", "ok", "error", 1);
+        }
+        return;
+    }
+
+    stopLoading();
+    stopFollowing();
+    closeViewer();
+
+    auto in = std::make_shared<std::ifstream>(path);
+    beginEdit(0, static_cast<int>(lines.size()), false);
+    lines.clear();
+    std::string text;
+    while (static_cast<int>(lines.size()) < LOAD_FIRST_LINES && std::getline(*in, text)) {
+        lines.push_back(std::move(text));
+    }
+    bool more = static_cast<int>(lines.size()) == LOAD_FIRST_LINES;
+    if (lines.empty()) {
+        lines.push_back("");
+    }
+    endEdit(static_cast<int>(lines.size()));
+
+    setLexerFor(path);
+    documentPath = path;
+    documentFinalNewline = fileEndsWithNewline(path);
+    recordDocumentStat();
+    journalReset(documentPath);
+
+    clearSelection();
+    clearExtraCarets();
+    jumpToFileStart();
+
+    loadTargetLine = line;
+    if (more) {
+        startLoading(in);
+    }
+    applyLoadedLines();
+}
+
+void loadFrom(const char* path) {
+    if (path != NULL) {
+        openFile(path, INT_MAX);
+    } else {
+        tinyfd_messageBox("Ogmios", "Cannot open the file !", "ok", "error", 1);
+    }
+}
+
+void handleDialogEvent(const SDL_UserEvent& event) {
+    dialogOpen = false;
+    std::unique_ptr<std::string> path(static_cast<std::string*>(event.data1));
+    const char* chosen = path ? path->c_str() : NULL;
+
+    if (event.code == DIALOG_SAVE) {
+        saveTo(chosen);
+    }
+    else if (event.code == DIALOG_OPEN) {
+        loadFrom(chosen);
+    }
+    else if (event.code == DIALOG_OVERWRITE && path) {
+        saveTo(chosen);
+    }
+    else if (event.code == DIALOG_CLOSE_TAB && path) {
+        for (int k = 0; k < static_cast<int>(buffers.size()); k++) {
+            if (std::to_string(buffers[k].id) == *path) {
+                removeBuffer(k);
+                break;
+            }
+        }
+    }
+    else if (event.code == DIALOG_RELOAD && path && *path == documentPath) {
+        reloadDiscarding = true;
+        reloadNeeded = true;
+    }
+}
+
+#pragma region BROWSER
+// Save and Open pick their file in a panel drawn over the editor. The directory is read by a pool
+// task with getdents64 and streamed in BROWSER_SCAN_BYTES at a time; every frame merges at most
+// BROWSER_ENTRIES_PER_FRAME of them into the list, so huge directories show up while they are read.
+struct BrowserEntry {
+    std::string name;
+    bool directory;
+};
+
+struct DirectoryRecord {    // the layout getdents64 fills in
+    uint64_t inode;
+    int64_t offset;
+    unsigned short length;
+    unsigned char type;
+    char name[1];
+};
+
+bool browserActive = false;
+int browserMode = DIALOG_OPEN;
+std::string browserDirectory;
+std::string browserQuery;
+std::vector<BrowserEntry> browserEntries;
+std::vector<int> browserScores;
+std::vector<int> browserOrder;      // indices in browserEntries, directories then names
+std::vector<int> browserMatches;    // the ones matching the query, best first
+int browserSelected = 0;
+int browserTop = 0;
+
+std::atomic<unsigned> browserGeneration(0);
+std::atomic<bool> browserScanning(false);
+std::mutex browserScannedMutex;
+std::deque<BrowserEntry> browserScanned;
+
+char lowerCase(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 'a' - 'A') : c;
+}
+
+bool isSeparator(char c) {
+    return c == '/' || c == '.' || c == '_' || c == '-' || c == ' ';
+}
+
+// Case-insensitive subsequence match of `query` in `text`, -1 when it does not match.
+// Matches at the start of words and runs of consecutive chars score higher.
+int fuzzyScore(const char* text, int length, const std::string& query) {
+    int score = 0;
+    int previous = -2;
+    int q = 0;
+    int querySize = static_cast<int>(query.size());
+    char wanted = querySize ? lowerCase(query[0]) : 0;
+    for (int i = 0; i < length && q < querySize; i++) {
+        if (lowerCase(text[i]) != wanted) {
+            continue;
+        }
+        score += 1;
+        if (i == 0 || isSeparator(text[i - 1])) {
+            score += 8;
+        }
+        if (i == previous + 1) {
+            score += 4;
+        }
+        previous = i;
+        q++;
+        wanted = q < querySize ? lowerCase(query[q]) : 0;
+    }
+    return q == querySize ? score * 64 - std::min(length, 63) : -1;
+}
+
+void scanDirectory(const std::string& path, unsigned generation) {
+    int directory = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    std::vector<char> buffer(BROWSER_SCAN_BYTES);
+    std::vector<BrowserEntry> batch;
+
+    while (directory >= 0 && generation == browserGeneration) {
+        long read = syscall(SYS_getdents64, directory, buffer.data(), buffer.size());
+        if (read <= 0) {
+            break;
+        }
+
+        batch.clear();
+        for (long offset = 0; offset < read; ) {
+            const DirectoryRecord* record = reinterpret_cast<const DirectoryRecord*>(buffer.data() + offset);
+            offset += record->length;
+            if (!strcmp(record->name, ".") || !strcmp(record->name, "..")) {
+                continue;
+            }
+
+            bool isDirectory = record->type == DT_DIR;
+            struct stat info;
+            if ((record->type == DT_UNKNOWN || record->type == DT_LNK) && fstatat(directory, record->name, &info, 0) == 0) {
+                isDirectory = S_ISDIR(info.st_mode);
+            }
+            batch.push_back({record->name, isDirectory});
+        }
+
+        std::lock_guard<std::mutex> lock(browserScannedMutex);
+        if (generation != browserGeneration) {
+            break;      // stopped, a newer scan may be running already
+        }
+        std::move(batch.begin(), batch.end(), std::back_inserter(browserScanned));
+    }
+
+    if (directory >= 0) {
+        close(directory);
+    }
+    std::lock_guard<std::mutex> lock(browserScannedMutex);
+    if (generation == browserGeneration) {
+        browserScanning = false;
+    }
+}
+
+// The scanner finds out on its own, what it reads past this point is dropped
+void stopBrowserScan() {
+    std::lock_guard<std::mutex> lock(browserScannedMutex);
+    browserGeneration++;
+    browserScanning = false;
+    browserScanned.clear();
+}
+
+bool browserNameBefore(int a, int b) {
+    if (browserEntries[a].directory != browserEntries[b].directory) {
+        return browserEntries[a].directory;
+    }
+    return browserEntries[a].name < browserEntries[b].name;
+}
+
+bool browserMatchBefore(int a, int b) {
+    if (browserScores[a] != browserScores[b]) {
+        return browserScores[a] > browserScores[b];
+    }
+    return browserNameBefore(a, b);
+}
+
+int scoreBrowserEntry(int i) {
+    const std::string& name = browserEntries[i].name;
+    return browserQuery.empty() ? 0 : fuzzyScore(name.data(), static_cast<int>(name.size()), browserQuery);
+}
+
+// Rescores the entries; when the query only grew, what did not match before cannot match now.
+// Walking them in name order leaves only scores to sort, which is a cheap integer compare.
+void filterBrowser(bool narrowed) {
+    browserMatches.clear();
+    for (int i : browserOrder) {
+        if (narrowed && browserScores[i] < 0) {
+            continue;
+        }
+        browserScores[i] = scoreBrowserEntry(i);
+        if (browserScores[i] >= 0) {
+            browserMatches.push_back(i);
+        }
+    }
+    std::stable_sort(browserMatches.begin(), browserMatches.end(), [](int a, int b) {
+        return browserScores[a] > browserScores[b];
+    });
+    browserSelected = 0;
+    browserTop = 0;
+}
+
+// Called every frame: merges what the scanner read since
+void applyBrowserEntries() {
+    if (!browserActive) {
+        return;
+    }
+
+    int first = static_cast<int>(browserEntries.size());
+    {
+        std::lock_guard<std::mutex> lock(browserScannedMutex);
+        for (int k = 0; k < BROWSER_ENTRIES_PER_FRAME && browserScanned.size(); k++) {
+            browserEntries.push_back(std::move(browserScanned.front()));
+            browserScanned.pop_front();
+        }
+    }
+    int last = static_cast<int>(browserEntries.size());
+    if (first == last) {
+        return;
+    }
+
+    size_t ordered = browserOrder.size();
+    size_t sorted = browserMatches.size();
+    for (int i = first; i < last; i++) {
+        browserScores.push_back(scoreBrowserEntry(i));
+        browserOrder.push_back(i);
+        if (browserScores[i] >= 0) {
+            browserMatches.push_back(i);
+        }
+    }
+    std::sort(browserOrder.begin() + ordered, browserOrder.end(), browserNameBefore);
+    std::inplace_merge(browserOrder.begin(), browserOrder.begin() + ordered, browserOrder.end(), browserNameBefore);
+    std::sort(browserMatches.begin() + sorted, browserMatches.end(), browserMatchBefore);
+    std::inplace_merge(browserMatches.begin(), browserMatches.begin() + sorted, browserMatches.end(), browserMatchBefore);
+}
+
+void browseDirectory(const std::string& path) {
+    stopBrowserScan();
+
+    char* resolved = realpath(path.c_str(), nullptr);
+    browserDirectory = resolved ? resolved : path;
+    free(resolved);
+
+    browserEntries.clear();
+    browserScores.clear();
+    browserOrder.clear();
+    if (browserDirectory != "/") {
+        browserEntries.push_back({"..", true});
+        browserScores.push_back(0);
+        browserOrder.push_back(0);
+    }
+    if (browserMode == DIALOG_OPEN) {
+        browserQuery.clear();
+    }
+    filterBrowser(false);
+
+    browserScanning = true;
+    unsigned generation = browserGeneration;
+    std::string directory = browserDirectory;
+    pool->submit([directory, generation] { scanDirectory(directory, generation); });
+}
+
+void openBrowser(int mode) {
+    browserActive = true;
+    browserMode = mode;
+
+    std::string directory = "Output";
+    browserQuery = mode == DIALOG_SAVE ? "unknow.txt" : "";
+    size_t slash = documentPath.rfind('/');
+    if (slash != std::string::npos) {
+        directory = documentPath.substr(0, std::max<size_t>(slash, 1));
+        browserQuery = mode == DIALOG_SAVE ? documentPath.substr(slash + 1) : "";
+    }
+    else if (documentPath.size()) {
+        directory = ".";
+        browserQuery = mode == DIALOG_SAVE ? documentPath : "";
+    }
+
+    struct stat info;
+    browseDirectory(stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode) ? directory : ".");
+}
+
+void closeBrowser() {
+    stopBrowserScan();
+    browserActive = false;
+    browserEntries.clear();
+    browserScores.clear();
+    browserOrder.clear();
+    browserMatches.clear();
+}
+
+std::string browserPath(const std::string& name) {
+    if (name.size() && name[0] == '/') {
+        return name;
+    }
+    return browserDirectory + (browserDirectory == "/" ? "" : "/") + name;
+}
+
+void enterBrowserDirectory(const std::string& name) {
+    if (name == "..") {
+        size_t slash = browserDirectory.rfind('/');
+        browseDirectory(slash ? browserDirectory.substr(0, slash) : "/");
+    } else {
+        browseDirectory(browserPath(name));
+    }
+}
+
+// Enter: directories are browsed into, files are opened. When saving, the query names the file
+void activateBrowser() {
+    const BrowserEntry* selected = browserMatches.empty() ? nullptr : &browserEntries[browserMatches[browserSelected]];
+    struct stat info;
+
+    if (browserMode == DIALOG_SAVE && browserQuery.size() && !(selected && selected->directory && selected->name == browserQuery)) {
+        std::string path = browserPath(browserQuery);
+        bool exists = stat(path.c_str(), &info) == 0;
+        if (exists && S_ISDIR(info.st_mode)) {
+            browserQuery.clear();
+            browseDirectory(path);
+            return;
+        }
+        if (exists && S_ISREG(info.st_mode)) {
+            if (requestDialog(DIALOG_OVERWRITE, path)) {
+                closeBrowser();
+            }
+            return;
+        }
+        closeBrowser();
+        saveTo(path.c_str());
+    }
+    else if (selected && selected->directory) {
+        std::string name = selected->name;
+        if (browserMode == DIALOG_SAVE) {
+            browserQuery.clear();
+        }
+        enterBrowserDirectory(name);
+    }
+    else if (selected && browserMode == DIALOG_OPEN) {
+        std::string path = browserPath(selected->name);
+        closeBrowser();
+        loadFrom(path.c_str());
+    }
+}
+
+int browserVisibleRows() {
+    return std::max(1, editorArea.h / lineHeight - 1);
+}
+
+void moveBrowserSelection(int delta) {
+    int count = static_cast<int>(browserMatches.size());
+    browserSelected = std::max(0, std::min(browserSelected + delta, count - 1));
+    if (browserSelected < browserTop) {
+        browserTop = browserSelected;
+    }
+    else if (browserSelected >= browserTop + browserVisibleRows()) {
+        browserTop = browserSelected - browserVisibleRows() + 1;
+    }
+}
+
+void typeInBrowser(const char* text) {
+    browserQuery += text;
+    filterBrowser(true);
+}
+
+void handleBrowserEvents(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_ESCAPE:
+            closeBrowser();
+            break;
+        case SDLK_RETURN:
+            activateBrowser();
+            break;
+        case SDLK_BACKSPACE:
+            if (browserQuery.size()) {
+                browserQuery.pop_back();
+                filterBrowser(false);
+            } else {
+                enterBrowserDirectory("..");
+            }
+            break;
+        case SDLK_TAB:              // COMPLETE THE SELECTED NAME
+            if (browserMatches.size()) {
+                const BrowserEntry& selected = browserEntries[browserMatches[browserSelected]];
+                if (selected.directory) {
+                    std::string name = selected.name;
+                    browserQuery.clear();
+                    enterBrowserDirectory(name);
+                } else {
+                    browserQuery = selected.name;
+                    filterBrowser(false);
+                }
+            }
+            break;
+        case SDLK_UP:
+            moveBrowserSelection(-1);
+            break;
+        case SDLK_DOWN:
+            moveBrowserSelection(1);
+            break;
+        case SDLK_PAGEUP:
+            moveBrowserSelection(-browserVisibleRows());
+            break;
+        case SDLK_PAGEDOWN:
+            moveBrowserSelection(browserVisibleRows());
+            break;
+        default:
+            break;
+    }
+}
+
+// A click selects a row, a click on the selected row activates it
+void handleBrowserPress(int y) {
+    int row = (y - editorArea.y) / lineHeight - 1;
+    if (y < editorArea.y || row < 0) {
+        return;
+    }
+
+    int clicked = browserTop + row;
+    if (clicked >= static_cast<int>(browserMatches.size())) {
+        return;
+    }
+    if (clicked == browserSelected) {
+        activateBrowser();
+    } else {
+        browserSelected = clicked;
+    }
+}
+
+void scrollBrowser(int rows) {
+    int count = static_cast<int>(browserMatches.size());
+    browserTop = std::max(0, std::min(browserTop + rows, count - browserVisibleRows()));
+}
+
+void renderLabel(const std::string& text, int x, int y, SDL_Color color) {
+    if (text.empty()) {
+        return;
+    }
+    SDL_Surface* s = TTF_RenderText_Blended(font, text.c_str(), color);
+    SDL_Texture* t = SDL_CreateTextureFromSurface(renderer, s);
+    SDL_Rect r = {x, y, s->w, s->h};
+    SDL_RenderCopy(renderer, t, nullptr, &r);
+    SDL_FreeSurface(s);
+    SDL_DestroyTexture(t);
+}
+
+void renderBrowser() {
+    SDL_RenderSetViewport(renderer, &editorArea);
+
+    SDL_Rect panel = {0, 0, editorArea.w, editorArea.h};
+    SDL_SetRenderDrawColor(renderer, textBackgroundColor[currentTheme].r, textBackgroundColor[currentTheme].g, textBackgroundColor[currentTheme].b, textBackgroundColor[currentTheme].a);
+    SDL_RenderFillRect(renderer, &panel);
+
+    SDL_Rect header = {0, 0, editorArea.w, lineHeight};
+    SDL_SetRenderDrawColor(renderer, UIBackgroundColor[currentTheme].r, UIBackgroundColor[currentTheme].g, UIBackgroundColor[currentTheme].b, UIBackgroundColor[currentTheme].a);
+    SDL_RenderFillRect(renderer, &header);
+
+    std::string title = (browserMode == DIALOG_SAVE ? "Save as: " : "Open: ") + browserPath("") + browserQuery + "|";
+    std::string count = std::to_string(browserMatches.size()) + " of " + std::to_string(browserEntries.size()) + (browserScanning ? ", reading..." : "");
+    renderLabel(title + "   (" + count + ")", BUTTON_SPAN * 2, 2, UIColor[currentTheme]);
+
+    int rows = browserVisibleRows();
+    for (int row = 0; row < rows && browserTop + row < static_cast<int>(browserMatches.size()); row++) {
+        int y = (row + 1) * lineHeight;
+        if (browserTop + row == browserSelected) {
+            SDL_Rect selected = {0, y, editorArea.w, lineHeight};
+            SDL_SetRenderDrawColor(renderer, selectionColor[currentTheme].r, selectionColor[currentTheme].g, selectionColor[currentTheme].b, selectionColor[currentTheme].a);
+            SDL_RenderFillRect(renderer, &selected);
+        }
+
+        const BrowserEntry& entry = browserEntries[browserMatches[browserTop + row]];
+        renderLabel(entry.directory ? entry.name + "/" : entry.name, editorLeftMargin, y + 2, entry.directory ? UIColor[currentTheme] : fontColor[currentTheme]);
+    }
+
+    SDL_RenderSetViewport(renderer, nullptr);
+}
+#pragma endregion
+
+#pragma region FINDER
+// Ctrl+P opens any file under the workspace (the directory Ogmios was started from) by typing
+// part of its path. The tree is crawled in parallel, one pool task per directory, and watched with
+// inotify. Paths are packed back to back in one string with a lower-cased twin and a mask of the
+// chars each one holds: a query skips every path whose mask lacks one of its chars and runs memchr
+// over the rest, each chunk of the index on its own task keeping only its best FINDER_RESULTS.
+// Removed paths are only flagged, until they are half of the index and it is packed again.
+struct FinderResult {
+    int score;
+    int index;
+};
+
+struct FinderDirectory {
+    std::unordered_map<std::string, int> files;     // name -> index of the path
+    std::vector<std::string> children;              // subdirectories holding some files
+};
+
+std::string finderRoot;
+std::string finderPaths;                // relative to finderRoot, back to back
+std::string finderLowerPaths;           // the same lower-cased, what queries scan
+std::vector<size_t> finderOffsets;      // path i is [finderOffsets[i], finderOffsets[i + 1])
+std::vector<uint64_t> finderMasks;
+std::vector<uint16_t> finderNameStarts;  // where the file name starts in each path
+std::vector<char> finderRemoved;
+int finderRemovedCount = 0;
+std::unordered_map<std::string, FinderDirectory> finderDirectories;    // relative path -> what is indexed in it
+
+bool finderActive = false;
+bool finderStarted = false;
+bool finderStale = false;               // the results predate the last paths added
+std::string finderQuery;
+std::vector<FinderResult> finderResults;
+int finderSelected = 0;
+int finderTop = 0;
+
+std::atomic<unsigned> finderGeneration(0);
+std::atomic<int> finderCrawling(0);     // directories queued or being read
+std::mutex finderFoundMutex;
+std::vector<std::string> finderFound;   // paths crawled since the last frame
+std::mutex finderWatchedMutex;
+int finderWatch = -1;                   // written under finderWatchedMutex, crawl tasks add to it
+std::unordered_map<int, std::string> finderWatched;    // watch descriptor -> directory
+
+// One bit per letter, digit and separator, so "every char of the query is in the path" is one AND
+uint64_t charMask(const char* text, size_t length) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 'a' && c <= 'z') {
+            mask |= 1ULL << (c - 'a');
+        }
+        else if (c >= '0' && c <= '9') {
+            mask |= 1ULL << (26 + c - '0');
+        }
+        else if (c < 128) {
+            mask |= 1ULL << (36 + c % 28);
+        }
+    }
+    return mask;
+}
+
+void crawlDirectory(const std::string& root, const std::string& relative, unsigned generation);
+
+// Crawls are tied to the generation they were started for: once the finder is stopped they
+// publish nothing more, so stopping never waits for them
+void submitCrawl(const std::string& root, const std::string& relative, unsigned generation) {
+    finderCrawling++;
+    pool->submit([root, relative, generation] { crawlDirectory(root, relative, generation); });
+}
+
+void crawlDirectory(const std::string& root, const std::string& relative, unsigned generation) {
+    std::string path = relative.empty() ? root : root + "/" + relative;
+    int directory = generation == finderGeneration ? open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+
+    if (directory >= 0) {
+        std::lock_guard<std::mutex> lock(finderWatchedMutex);
+        int watch = generation == finderGeneration && finderWatch >= 0
+            ? inotify_add_watch(finderWatch, path.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+            : -1;
+        if (watch >= 0) {
+            finderWatched[watch] = relative;
+        }
+    }
+
+    std::vector<char> buffer(BROWSER_SCAN_BYTES);
+    std::vector<std::string> files;
+    while (directory >= 0 && generation == finderGeneration) {
+        long read = syscall(SYS_getdents64, directory, buffer.data(), buffer.size());
+        if (read <= 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < read; ) {
+            const DirectoryRecord* record = reinterpret_cast<const DirectoryRecord*>(buffer.data() + offset);
+            offset += record->length;
+            if (record->name[0] == '.' && (record->name[1] == '\0' || record->name[1] == '.' || record->type == DT_DIR)) {
+                continue;   // ".", ".." and hidden directories (.git...)
+            }
+
+            unsigned char type = record->type;
+            struct stat info;
+            if (type == DT_UNKNOWN && fstatat(directory, record->name, &info, AT_SYMLINK_NOFOLLOW) == 0) {
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+
+            std::string child = relative.empty() ? std::string(record->name) : relative + "/" + record->name;
+            if (type == DT_DIR) {
+                submitCrawl(root, child, generation);
+            }
+            else if (type == DT_REG || type == DT_LNK) {
+                files.push_back(std::move(child));
+            }
+        }
+    }
+
+    if (directory >= 0) {
+        close(directory);
+    }
+    if (files.size()) {
+        std::lock_guard<std::mutex> lock(finderFoundMutex);
+        if (generation == finderGeneration) {
+            std::move(files.begin(), files.end(), std::back_inserter(finderFound));
+        }
+    }
+    finderCrawling--;
+}
+
+int finderPathCount() {
+    return static_cast<int>(finderOffsets.size()) - 1;
+}
+
+std::string finderParent(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+FinderDirectory& finderDirectory(const std::string& path) {
+    auto found = finderDirectories.find(path);
+    if (found != finderDirectories.end()) {
+        return found->second;
+    }
+    if (path.size()) {
+        finderDirectory(finderParent(path)).children.push_back(path);
+    }
+    return finderDirectories[path];
+}
+
+void addFinderPath(const std::string& path) {
+    size_t slash = path.rfind('/');
+    FinderDirectory& directory = finderDirectory(finderParent(path));
+    if (!directory.files.emplace(slash == std::string::npos ? path : path.substr(slash + 1), finderPathCount()).second) {
+        return;     // already indexed, a file replaced by another one
+    }
+
+    finderPaths += path;
+    for (char c : path) {
+        finderLowerPaths += lowerCase(c);
+    }
+    finderOffsets.push_back(finderPaths.size());
+    finderMasks.push_back(charMask(finderLowerPaths.data() + finderLowerPaths.size() - path.size(), path.size()));
+    finderNameStarts.push_back(static_cast<uint16_t>(slash == std::string::npos ? 0 : std::min<size_t>(slash + 1, UINT16_MAX)));
+    finderRemoved.push_back(0);
+    finderStale = true;
+}
+
+std::string finderPath(int i) {
+    return finderPaths.substr(finderOffsets[i], finderOffsets[i + 1] - finderOffsets[i]);
+}
+
+// Packs the paths left, renumbering them, once the removed ones are half of the index
+void compactFinder() {
+    int count = finderPathCount();
+    if (finderRemovedCount < FINDER_COMPACT_MIN || finderRemovedCount * 2 < count) {
+        return;
+    }
+
+    std::vector<int> renumbered(count, -1);
+    int kept = 0;
+    size_t end = 0;
+    for (int i = 0; i < count; i++) {
+        if (finderRemoved[i]) {
+            continue;
+        }
+        size_t start = finderOffsets[i];
+        size_t length = finderOffsets[i + 1] - start;
+        memmove(&finderPaths[end], finderPaths.data() + start, length);
+        memmove(&finderLowerPaths[end], finderLowerPaths.data() + start, length);
+        end += length;
+        finderOffsets[kept + 1] = end;
+        finderMasks[kept] = finderMasks[i];
+        finderNameStarts[kept] = finderNameStarts[i];
+        renumbered[i] = kept++;
+    }
+    finderPaths.resize(end);
+    finderLowerPaths.resize(end);
+    finderOffsets.resize(kept + 1);
+    finderMasks.resize(kept);
+    finderNameStarts.resize(kept);
+    finderRemoved.assign(kept, 0);
+    finderRemovedCount = 0;
+
+    for (auto& directory : finderDirectories) {
+        for (auto& file : directory.second.files) {
+            file.second = renumbered[file.second];
+        }
+    }
+    finderResults.clear();
+    finderStale = true;
+}
+
+void removeFinderPath(int i) {
+    finderRemoved[i] = 1;
+    finderRemovedCount++;
+    finderStale = true;
+}
+
+void removeFinderDirectory(const std::string& path) {
+    auto found = finderDirectories.find(path);
+    if (found == finderDirectories.end()) {
+        return;
+    }
+    FinderDirectory directory = std::move(found->second);
+    finderDirectories.erase(found);
+
+    for (const auto& file : directory.files) {
+        removeFinderPath(file.second);
+    }
+    for (const std::string& child : directory.children) {
+        removeFinderDirectory(child);
+    }
+}
+
+// Marks `path` removed, and everything under it when it is a directory
+void removeFinderPaths(const std::string& path, bool directory) {
+    auto parent = finderDirectories.find(finderParent(path));
+    if (directory) {
+        if (parent != finderDirectories.end()) {
+            std::vector<std::string>& children = parent->second.children;
+            children.erase(std::remove(children.begin(), children.end(), path), children.end());
+        }
+        removeFinderDirectory(path);
+    }
+    else if (parent != finderDirectories.end()) {
+        size_t slash = path.rfind('/');
+        auto file = parent->second.files.find(slash == std::string::npos ? path : path.substr(slash + 1));
+        if (file != parent->second.files.end()) {
+            removeFinderPath(file->second);
+            parent->second.files.erase(file);
+        }
+    }
+    compactFinder();
+}
+
+void startFinder() {
+    finderStarted = true;
+
+    char* root = getcwd(nullptr, 0);
+    finderRoot = root ? root : ".";
+    free(root);
+
+    finderPaths.clear();
+    finderLowerPaths.clear();
+    finderOffsets.assign(1, 0);
+    finderMasks.clear();
+    finderNameStarts.clear();
+    finderRemoved.clear();
+    finderRemovedCount = 0;
+    finderDirectories.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(finderWatchedMutex);
+        finderWatch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    submitCrawl(finderRoot, "", finderGeneration);
+}
+
+void stopFinder() {
+    {
+        std::lock_guard<std::mutex> lock(finderWatchedMutex);
+        finderGeneration++;
+        if (finderWatch >= 0) {
+            close(finderWatch);
+            finderWatch = -1;
+        }
+        finderWatched.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(finderFoundMutex);
+        finderFound.clear();
+    }
+    finderStarted = false;
+}
+
+// Keeps the index in step with the files created, moved and deleted under the root
+void pollFinderWatch() {
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t length;
+    while (finderWatch >= 0 && (length = read(finderWatch, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                stopFinder();       // events were lost, crawl again
+                startFinder();
+                return;
+            }
+
+            std::string directory;
+            {
+                std::lock_guard<std::mutex> lock(finderWatchedMutex);
+                auto watched = finderWatched.find(event->wd);
+                if (watched == finderWatched.end()) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    finderWatched.erase(watched);
+                    continue;
+                }
+                directory = watched->second;
+            }
+            if (event->len == 0 || (event->name[0] == '.' && (event->mask & IN_ISDIR))) {
+                continue;
+            }
+
+            std::string path = directory.empty() ? std::string(event->name) : directory + "/" + event->name;
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                removeFinderPaths(path, event->mask & IN_ISDIR);
+            }
+            else if (event->mask & IN_ISDIR) {
+                submitCrawl(finderRoot, path, finderGeneration);
+            }
+            else {
+                addFinderPath(path);
+            }
+        }
+    }
+}
+
+void runFinderQuery() {
+    finderSelected = 0;
+    finderTop = 0;
+    finderStale = false;
+    finderResults.clear();
+
+    std::string query;
+    for (char c : finderQuery) {
+        if (c != ' ') {
+            query += lowerCase(c);
+        }
+    }
+    uint64_t mask = charMask(query.data(), query.size());
+
+    int count = finderPathCount();
+    if (query.empty()) {
+        for (int i = 0; i < count && static_cast<int>(finderResults.size()) < FINDER_RESULTS; i++) {
+            if (!finderRemoved[i]) {
+                finderResults.push_back({0, i});
+            }
+        }
+        return;
+    }
 
-    viewport.h += lineHeight;
-}
+    int chunkCount = (count + FINDER_CHUNK_PATHS - 1) / FINDER_CHUNK_PATHS;
+    std::vector<std::vector<FinderResult>> found(chunkCount);
+    int pathScoreMax = static_cast<int>(query.size()) * 13 * 64;    // fuzzyScore with every bonus
+    auto better = [](const FinderResult& a, const FinderResult& b) {
+        return a.score != b.score ? a.score > b.score : a.index < b.index;
+    };
+
+    auto searchChunk = [&](int chunk) {
+        std::vector<FinderResult>& results = found[chunk];
+        int threshold = INT_MIN;    // what a path must beat once FINDER_RESULTS are kept
+        int last = std::min(count, (chunk + 1) * FINDER_CHUNK_PATHS);
+        for (int i = chunk * FINDER_CHUNK_PATHS; i < last; i++) {
+            if (finderRemoved[i] || (finderMasks[i] & mask) != mask) {
+                continue;
+            }
 
-bool deleteCurrentLine() {
-    bool deleted = false;
+            // Matching within the file name beats matching across directories, and only needs
+            // the few chars after the last slash scored
+            const char* start = finderLowerPaths.data() + finderOffsets[i];
+            const char* end = finderLowerPaths.data() + finderOffsets[i + 1];
+            int length = static_cast<int>(end - start);
+            int nameStart = std::min<int>(finderNameStarts[i], length);
+            int score = fuzzyScore(start + nameStart, length - nameStart, query);
+            if (score >= 0) {
+                score *= 3;
+            }
+            else if (pathScoreMax > threshold) {
+                const char* at = start;
+                for (size_t q = 0; at && q < query.size(); q++) {
+                    at = static_cast<const char*>(memchr(at, query[q], end - at));
+                    at = at ? at + 1 : nullptr;
+                }
+                if (!at) {
+                    continue;
+                }
+                score = fuzzyScore(start, length, query);
+            }
+            else {
+                continue;
+            }
+            score -= std::min(length, 63);
+            if (score <= threshold) {
+                continue;
+            }
 
-    if (cursorX == 0 && cursorY > 0) {
-        std::string oldLine = lines[cursorY];
-        lines.erase(lines.begin() + cursorY);
-        moveCursorUp();
-        cursorX = static_cast<int>(lines[cursorY].size());
-        updateRenderCursorX();
+            results.push_back({score, i});
+            if (static_cast<int>(results.size()) >= FINDER_RESULTS * 4) {
+                std::nth_element(results.begin(), results.begin() + FINDER_RESULTS - 1, results.end(), better);
+                results.resize(FINDER_RESULTS);
+                threshold = results.back().score;
+            }
+        }
+    };
 
-        if (oldLine.size()) {
-            lines[cursorY].append(oldLine);
+    // The crawl keeps the pool busy, the query would wait behind it
+    if (finderCrawling) {
+        for (int chunk = 0; chunk < chunkCount; chunk++) {
+            searchChunk(chunk);
         }
+    } else {
+        parallelFor(chunkCount, searchChunk);
+    }
 
-        viewport.h -= lineHeight;
+    for (const std::vector<FinderResult>& results : found) {
+        finderResults.insert(finderResults.end(), results.begin(), results.end());
+    }
+    int kept = std::min(FINDER_RESULTS, static_cast<int>(finderResults.size()));
+    std::partial_sort(finderResults.begin(), finderResults.begin() + kept, finderResults.end(), better);
+    finderResults.resize(kept);
+}
 
-        deleted = true;
+// Called every frame: indexes what the crawl found and what inotify reported
+void updateFinder() {
+    if (!finderStarted) {
+        return;
     }
 
-    return deleted;
+    std::vector<std::string> found;
+    {
+        std::lock_guard<std::mutex> lock(finderFoundMutex);
+        found.swap(finderFound);
+    }
+    for (const std::string& path : found) {
+        addFinderPath(path);
+    }
+    pollFinderWatch();
+
+    if (finderActive && finderStale) {
+        int selected = finderSelected;
+        runFinderQuery();
+        finderSelected = std::min(selected, std::max(0, static_cast<int>(finderResults.size()) - 1));
+    }
 }
 
-bool deleteNextLine() {
-    bool deleted = false;
+void openFinder() {
+    if (!finderStarted) {
+        startFinder();
+    }
+    finderActive = true;
+    finderQuery.clear();
+    runFinderQuery();
+}
 
-    if (cursorX == static_cast<int>(lines[cursorY].size()) &&
-        cursorY < static_cast<int>(lines.size() - 1)
-    ) {
-        std::string oldLine = lines[cursorY + 1];
-        lines.erase(lines.begin() + cursorY + 1);
-        
-        if (oldLine.size()) {
-            lines[cursorY].append(oldLine);
-        }
+void closeFinder() {
+    finderActive = false;
+    finderResults.clear();
+}
 
-        viewport.h -= lineHeight;
+int finderVisibleRows() {
+    return std::max(1, editorArea.h / lineHeight - 1);
+}
 
-        deleted = true;
+void moveFinderSelection(int delta) {
+    int count = static_cast<int>(finderResults.size());
+    finderSelected = std::max(0, std::min(finderSelected + delta, count - 1));
+    if (finderSelected < finderTop) {
+        finderTop = finderSelected;
+    }
+    else if (finderSelected >= finderTop + finderVisibleRows()) {
+        finderTop = finderSelected - finderVisibleRows() + 1;
     }
+}
 
-    return deleted;
+void activateFinder() {
+    if (finderResults.empty()) {
+        return;
+    }
+    std::string path = finderRoot + "/" + finderPath(finderResults[finderSelected].index);
+    closeFinder();
+    openFile(path, 0);
 }
 
-void clearEditor() {
-    lines.clear();
-    lines.push_back("");
+void typeInFinder(const char* text) {
+    finderQuery += text;
+    runFinderQuery();
+}
 
-    jumpToFileStart();
+void handleFinderEvents(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_ESCAPE:
+            closeFinder();
+            break;
+        case SDLK_RETURN:
+            activateFinder();
+            break;
+        case SDLK_BACKSPACE:
+            if (finderQuery.size()) {
+                finderQuery.pop_back();
+                runFinderQuery();
+            }
+            break;
+        case SDLK_UP:
+            moveFinderSelection(-1);
+            break;
+        case SDLK_DOWN:
+            moveFinderSelection(1);
+            break;
+        case SDLK_PAGEUP:
+            moveFinderSelection(-finderVisibleRows());
+            break;
+        case SDLK_PAGEDOWN:
+            moveFinderSelection(finderVisibleRows());
+            break;
+        default:
+            break;
+    }
 }
 
+void handleFinderPress(int y) {
+    int row = (y - editorArea.y) / lineHeight - 1;
+    if (y < editorArea.y || row < 0 || finderTop + row >= static_cast<int>(finderResults.size())) {
+        return;
+    }
+    if (finderTop + row == finderSelected) {
+        activateFinder();
+    } else {
+        finderSelected = finderTop + row;
+    }
+}
 
-void save() {
-    char const * filterPatterns[2] = { "*.txt", "*.text" };
-    char* path = tinyfd_saveFileDialog("Save", "./Output/unknow.txt", 2, filterPatterns, NULL);
-    
-    if (path != NULL) {
-        std::ofstream out(path);
-        for (const std::string& line : lines) {
-            out << line << std::endl;
+void scrollFinder(int rows) {
+    int count = static_cast<int>(finderResults.size());
+    finderTop = std::max(0, std::min(finderTop + rows, count - finderVisibleRows()));
+}
+
+void renderFinder() {
+    SDL_RenderSetViewport(renderer, &editorArea);
+
+    SDL_Rect panel = {0, 0, editorArea.w, editorArea.h};
+    SDL_SetRenderDrawColor(renderer, textBackgroundColor[currentTheme].r, textBackgroundColor[currentTheme].g, textBackgroundColor[currentTheme].b, textBackgroundColor[currentTheme].a);
+    SDL_RenderFillRect(renderer, &panel);
+
+    SDL_Rect header = {0, 0, editorArea.w, lineHeight};
+    SDL_SetRenderDrawColor(renderer, UIBackgroundColor[currentTheme].r, UIBackgroundColor[currentTheme].g, UIBackgroundColor[currentTheme].b, UIBackgroundColor[currentTheme].a);
+    SDL_RenderFillRect(renderer, &header);
+
+    std::string count = std::to_string(finderPathCount()) + " files" + (finderCrawling ? ", indexing..." : "");
+    renderLabel("Go to file: " + finderQuery + "|   (" + count + ")", BUTTON_SPAN * 2, 2, UIColor[currentTheme]);
+
+    int rows = finderVisibleRows();
+    for (int row = 0; row < rows && finderTop + row < static_cast<int>(finderResults.size()); row++) {
+        int y = (row + 1) * lineHeight;
+        if (finderTop + row == finderSelected) {
+            SDL_Rect selected = {0, y, editorArea.w, lineHeight};
+            SDL_SetRenderDrawColor(renderer, selectionColor[currentTheme].r, selectionColor[currentTheme].g, selectionColor[currentTheme].b, selectionColor[currentTheme].a);
+            SDL_RenderFillRect(renderer, &selected);
         }
-        out.close();
+        renderLabel(finderPath(finderResults[finderTop + row].index), editorLeftMargin, y + 2, fontColor[currentTheme]);
+    }
 
-        clearEditor();
+    SDL_RenderSetViewport(renderer, nullptr);
+}
+#pragma endregion
+
+
+void save() {
+    if (viewerMode) {
+        tinyfd_messageBox("Ogmios", "Files opened in the viewer are read-only !", "ok", "warning", 1);
+        return;
+    }
+
+    if (nativeDialogs) {
+        requestDialog(DIALOG_SAVE);
     } else {
-        tinyfd_messageBox("Ogmios", "Cannot save the file !", "ok", "error", 1);
+        openBrowser(DIALOG_SAVE);
     }
 }
 
 void load() {
-    char const * filterPatterns[2] = { "*.txt", "*.text" };
-    char* path = tinyfd_openFileDialog("Open", "Output/unknow.txt", 2, filterPatterns, NULL, 0);
+    if (nativeDialogs) {
+        requestDialog(DIALOG_OPEN);
+    } else {
+        openBrowser(DIALOG_OPEN);
+    }
+}
 
-    if (path != NULL) {
-        lines.clear();
-        std::ifstream in(path);
-        std::string line;
-        while (std::getline(in, line)) {
-            lines.push_back(line);
-        }
-        in.close();
 
-        jumpToFileEnd();
+// "path:line" opens at that 1-based line, unless a file is really named so
+void openFileArgument(const std::string& argument) {
+    size_t colon = argument.rfind(':');
+    struct stat info;
+    if (colon != std::string::npos && colon + 1 < argument.size() && stat(argument.c_str(), &info) != 0 &&
+        std::all_of(argument.begin() + colon + 1, argument.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        openFile(argument.substr(0, colon), std::max(0, atoi(argument.c_str() + colon + 1) - 1));
     } else {
-        tinyfd_messageBox("Ogmios", "Cannot open the file !", "ok", "error", 1);
+        openFile(argument, 0);
     }
 }
 
 
 void updateScrollBar() {
-    scrollBar.h = (windowHeight - UI.h) * (windowHeight - UI.h) / static_cast<int>(lines.size() * lineHeight);
-    scrollBar.y = scrollPosition * (windowHeight - UI.h - scrollBar.h) / static_cast<int>(lines.size() * lineHeight);
+    int visibleHeight = viewFrame.h;
+    int contentHeight = std::max(visibleHeight, visualLineCount() * lineHeight);
+
+    scrollPixels = std::min(scrollPixels, static_cast<double>(lineHeight - 1));
+    int top = scrollPosition * lineHeight + static_cast<int>(scrollPixels);
 
-    viewport.y = -scrollPosition * lineHeight + UI.h;
+    viewport.x = viewFrame.x;
+    viewport.y = -top + viewFrame.y;
+    viewport.w = viewFrame.w;
+    viewport.h = visibleHeight + top;
+
+    scrollBar.x = viewFrame.w - SCROLL_BAR_WIDTH;
+    scrollBar.h = visibleHeight * visibleHeight / contentHeight;
+    scrollBar.y = top + static_cast<int>(static_cast<long long>(top) * (visibleHeight - scrollBar.h) / contentHeight);
+}
+
+// The viewport runs up past the view to its first row, which a wrapped line may start above
+void clipToView() {
+    SDL_Rect clip = {0, scrollPosition * lineHeight + static_cast<int>(scrollPixels), viewFrame.w, viewFrame.h};
+    SDL_RenderSetClipRect(renderer, &clip);
 }
 
 void updateTheme() {
@@ -446,61 +6453,230 @@ void updateTheme() {
 void updateFontSize(TTF_Font* f, int s) {
     currentFontSize += s;
 
+    pauseBackgroundWork();
     TTF_SetFontSize(f, currentFontSize);
+    updateFontMetrics();
+    resumeBackgroundWork();
 
     if (currentFontSize != DEFAULT_FONT_SIZE) {
         lineHeight += s;
         editorLeftMargin += s;
     }
 
+    relayoutDocument();
+
     updateRenderCursorX();
     updateRenderCursorY();
 }
 
 
+#pragma region TEXT CACHE
+// Rendered runs and line numbers, by text, colour and font size. Scrolling only renders the lines
+// coming into view and the views share what they draw; once the cache is full, whatever the last
+// frame did not draw goes.
+struct CachedText {
+    SDL_Texture* texture;
+    int w;
+    int h;
+    unsigned frame;
+};
+
+std::unordered_map<std::string, CachedText> textCache;
+unsigned textCacheFrame = 0;
+
+const CachedText* cachedText(const std::string& text, SDL_Color color) {
+    std::string key = text;
+    key.push_back('\0');
+    key.append(reinterpret_cast<const char*>(&color), sizeof(color));
+    key.append(reinterpret_cast<const char*>(&currentFontSize), sizeof(currentFontSize));
+
+    auto it = textCache.find(key);
+    if (it == textCache.end()) {
+        SDL_Surface* surface = TTF_RenderText_Blended(font, text.c_str(), color);
+        if (!surface) {
+            return nullptr;
+        }
+        CachedText entry = {SDL_CreateTextureFromSurface(renderer, surface), surface->w, surface->h, 0};
+        SDL_FreeSurface(surface);
+        it = textCache.emplace(std::move(key), entry).first;
+    }
+    it->second.frame = textCacheFrame;
+    return &it->second;
+}
+
+// Called once per frame, after drawing
+void trimTextCache() {
+    if (textCache.size() > static_cast<size_t>(TEXT_CACHE_ENTRIES)) {
+        for (auto it = textCache.begin(); it != textCache.end(); ) {
+            if (it->second.frame != textCacheFrame) {
+                SDL_DestroyTexture(it->second.texture);
+                it = textCache.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    textCacheFrame++;
+}
+
+void clearTextCache() {
+    for (auto& entry : textCache) {
+        SDL_DestroyTexture(entry.second.texture);
+    }
+    textCache.clear();
+}
+#pragma endregion
+
+
+// Draws `subline` chars [from, to) in the colour of `token`
+void renderRun(const std::string& subline, int from, int to, int token, int y) {
+    std::string text = subline.substr(from, to - from);
+    if (monospaceFont) {
+        text = expandTabs(text, columnOf(subline, from));
+    }
+
+    const CachedText* run = cachedText(text, tokenColor[currentTheme][token]);
+    if (!run) {
+        return;
+    }
+    SDL_Rect tR = {editorLeftMargin + textWidth(subline, from), y, run->w, run->h};
+    SDL_RenderCopy(renderer, run->texture, nullptr, &tR);
+}
+
+// Sub-line `j` of line `i`, one draw per run of same-coloured chars
+void renderSubline(int i, int j, int y) {
+    int start = sublineStart(i, j);
+    int end = sublineEnd(i, j);
+    std::string subline = lines[i].substr(start, end - start);
+
+    if (i >= highlightValidUpTo || highlights[i].spans.empty()) {
+        renderRun(subline, 0, end - start, TOKEN_TEXT, y);
+        return;
+    }
+
+    const std::vector<Span>& spans = highlights[i].spans;
+    auto span = std::find_if(spans.begin(), spans.end(), [start](const Span& s) { return s.start + s.length > start; });
+
+    for (int position = start; position < end; ) {
+        int token = TOKEN_TEXT;
+        int runEnd = end;
+        if (span != spans.end() && span->start <= position) {
+            token = span->token;
+            runEnd = std::min(end, span->start + span->length);
+            span++;
+        } else if (span != spans.end()) {
+            runEnd = std::min(end, span->start);
+        }
+
+        renderRun(subline, position - start, runEnd - start, token, y);
+        position = runEnd;
+    }
+}
+
+// Fills the background of chars [from, to) of line `i`, `trailing` pixels past the last one
+void fillColumns(int i, int from, int to, int y, int trailing) {
+    int last = sublineOf(i, std::max(from, to - 1));
+    for (int j = sublineOf(i, from); j <= last; j++) {
+        int start = sublineStart(i, j);
+        std::string subline = lines[i].substr(start, sublineEnd(i, j) - start);
+        int x0 = textWidth(subline, std::max(from, start) - start);
+        int x1 = textWidth(subline, std::min(to, sublineEnd(i, j)) - start) + (j == last ? trailing : 0);
+
+        SDL_Rect r = {editorLeftMargin + x0, y + j * lineHeight, x1 - x0, lineHeight};
+        SDL_RenderFillRect(renderer, &r);
+    }
+}
+
 void renderText() {
     SDL_RenderSetViewport(renderer, &viewport);
+    clipToView();
+
+    // Selections of every cursor, in document order
+    std::vector<TextRange> selections;
+    if (hasSelection()) {
+        TextRange range;
+        selectionBounds(range.startX, range.startY, range.endX, range.endY);
+        selections.push_back(range);
+    }
+    for (const Caret& c : extraCarets) {
+        if (c.selecting && (c.x != c.anchorX || c.y != c.anchorY) && std::max(c.y, c.anchorY) < static_cast<int>(lines.size())) {
+            bool anchorFirst = positionBefore(c.anchorX, c.anchorY, c.x, c.y);
+            selections.push_back(anchorFirst ? TextRange{c.anchorX, c.anchorY, c.x, c.y} : TextRange{c.x, c.y, c.anchorX, c.anchorY});
+        }
+    }
+    std::sort(selections.begin(), selections.end(), [](const TextRange& a, const TextRange& b) {
+        return a.endY < b.endY;
+    });
 
-    int y = 2;
-    for (int i = 0; i < static_cast<int>(lines.size()); i++) {
-        // Render Line Index
-        std::string index = std::to_string(i);
-        SDL_Surface* iS = TTF_RenderText_Blended(font, index.c_str(), UIColor[currentTheme]);
-        SDL_Texture* iT = SDL_CreateTextureFromSurface(renderer, iS);
-        SDL_Rect iR = {2, y, iS->w, iS->h};
+    int bracketX, bracketY, matchX, matchY;
+    bool bracketMatched = cursorBracketPair(bracketX, bracketY, matchX, matchY);
 
-        SDL_RenderCopy(renderer, iT, nullptr, &iR);
-        SDL_FreeSurface(iS);
-        SDL_DestroyTexture(iT);
+    int bottom = (scrollPosition + viewFrame.h / lineHeight + 2);
+    for (int i = lineAtVisual(scrollPosition); i < static_cast<int>(lines.size()) && rowOfLine(i) <= bottom; i = nextVisibleLine(i)) {
+        int y = rowOfLine(i) * lineHeight + 2;
+
+        // Render Line Index
+        const CachedText* index = cachedText(std::to_string(i), UIColor[currentTheme]);
+        SDL_Rect iR = {2, y, index ? index->w : 0, index ? index->h : lineHeight};
+        if (index) {
+            SDL_RenderCopy(renderer, index->texture, nullptr, &iR);
+        }
 
         // Render Separator
         SDL_SetRenderDrawColor(renderer, 51, 51, 51, 255);
         SDL_RenderDrawLine(renderer, editorLeftMargin - 2, iR.y + 1, editorLeftMargin - 2, iR.y + iR.h - 1);
 
+        // Render Fold Marker
+        if (nextVisibleLine(i) != i + 1) {
+            int under = y + rowCount(i) * lineHeight - 1;
+            SDL_SetRenderDrawColor(renderer, UIColor[currentTheme].r, UIColor[currentTheme].g, UIColor[currentTheme].b, UIColor[currentTheme].a);
+            SDL_RenderDrawLine(renderer, editorLeftMargin, under, editorLeftMargin + wrapWidth(viewFrame), under);
+        }
+
+        // Render Selections
+        SDL_SetRenderDrawColor(renderer, selectionColor[currentTheme].r, selectionColor[currentTheme].g, selectionColor[currentTheme].b, selectionColor[currentTheme].a);
+        auto selection = std::lower_bound(selections.begin(), selections.end(), i, [](const TextRange& r, int line) { return r.endY < line; });
+        for (; selection != selections.end() && selection->startY <= i; selection++) {
+            int from = i == selection->startY ? selection->startX : 0;
+            int to = i == selection->endY ? selection->endX : static_cast<int>(lines[i].size());
+            int newline = i < selection->endY ? lineHeight / 3 : 0;
+            fillColumns(i, from, to, y, newline);
+        }
+
+        // Render Search Matches
+        auto matches = searchMatchesOn(i);
+        SDL_SetRenderDrawColor(renderer, searchHighlightColor[currentTheme].r, searchHighlightColor[currentTheme].g, searchHighlightColor[currentTheme].b, searchHighlightColor[currentTheme].a);
+        for (const SearchMatch* m = matches.first; m != matches.second; m++) {
+            fillColumns(i, m->column, m->column + m->length, y, 0);
+        }
+
+        // Render Bracket Pair
+        if (bracketMatched && (i == bracketY || i == matchY)) {
+            SDL_SetRenderDrawColor(renderer, bracketColor[currentTheme].r, bracketColor[currentTheme].g, bracketColor[currentTheme].b, bracketColor[currentTheme].a);
+            if (i == bracketY) {
+                fillColumns(i, bracketX, bracketX + 1, y, 0);
+            }
+            if (i == matchY) {
+                fillColumns(i, matchX, matchX + 1, y, 0);
+            }
+        }
+
         // Render Line Text
         if (lines[i].size()) {
-            auto tempLines = splitLine(lines[i], font, windowWidth - editorLeftMargin);
-            for (int j = 0; j < static_cast<int>(tempLines.size()); j++) {
-                SDL_Surface* tS = TTF_RenderText_Blended(font, tempLines[j].c_str(), fontColor[currentTheme]);
-                SDL_Texture* tT = SDL_CreateTextureFromSurface(renderer, tS);
-                SDL_Rect tR = {editorLeftMargin, y, tS->w, tS->h};
-
-                SDL_RenderCopy(renderer, tT, nullptr, &tR);
-                SDL_FreeSurface(tS);
-                SDL_DestroyTexture(tT);
-                
+            for (int j = 0; j < rowCount(i); j++) {
+                renderSubline(i, j, y);
                 y += lineHeight;
             }
-        } else {
-            y += lineHeight;
         }
     }
 
+    SDL_RenderSetClipRect(renderer, nullptr);
     SDL_RenderSetViewport(renderer, nullptr);
 }
 
 void renderCursor() {
     SDL_RenderSetViewport(renderer, &viewport);
+    clipToView();
 
     SDL_SetRenderDrawColor(renderer, cursorColor[currentTheme].r, cursorColor[currentTheme].g, cursorColor[currentTheme].b, cursorColor[currentTheme].a);
     SDL_RenderDrawLine(renderer,
@@ -510,17 +6686,31 @@ void renderCursor() {
         rCursorY + lineHeight
         );
 
+    int bottom = scrollPosition + viewFrame.h / lineHeight + 2;
+    for (const Caret& c : extraCarets) {
+        if (c.y >= static_cast<int>(lines.size()) || lineHidden(c.y) || rowOfLine(c.y + 1) <= scrollPosition || rowOfLine(c.y) > bottom) {
+            continue;
+        }
+        int x, y;
+        caretPosition(std::min(c.x, static_cast<int>(lines[c.y].size())), c.y, x, y);
+        SDL_RenderDrawLine(renderer, x, y + 4, x, y + lineHeight);
+    }
+
+    SDL_RenderSetClipRect(renderer, nullptr);
     SDL_RenderSetViewport(renderer, nullptr);
 }
 
-void renderUI() {
-    TTF_SetFontSize(font, DEFAULT_FONT_SIZE);
-
-    // Scroll Bar
+void renderScrollBar() {
     SDL_RenderSetViewport(renderer, &viewport);
     SDL_SetRenderDrawColor(renderer, UIColor[currentTheme].r, UIColor[currentTheme].g, UIColor[currentTheme].b, UIColor[currentTheme].a / 2);
     SDL_RenderFillRect(renderer, &scrollBar);
     SDL_RenderSetViewport(renderer, nullptr);
+}
+
+void renderUI() {
+    TTF_SetFontSize(font, DEFAULT_FONT_SIZE);
+
+    renderScrollBar();
 
     // Background
     SDL_SetRenderDrawColor(renderer, UIBackgroundColor[currentTheme].r, UIBackgroundColor[currentTheme].g, UIBackgroundColor[currentTheme].b, UIBackgroundColor[currentTheme].a);
@@ -554,113 +6744,493 @@ void renderUI() {
     SDL_DestroyTexture(loadButtonTexture);
     #pragma endregion
 
-    #pragma region SIZE BUTTONS
-    // Minus Button
-    SDL_RenderDrawRect(renderer, &minusButtonBox);
+    #pragma region SIZE BUTTONS
+    // Minus Button
+    SDL_RenderDrawRect(renderer, &minusButtonBox);
+
+    SDL_Surface* minusButtonSurface = TTF_RenderText_Blended(font, "-", UIColor[currentTheme]);
+    SDL_Texture* minusButtonTexture = SDL_CreateTextureFromSurface(renderer, minusButtonSurface);
+    SDL_Rect minusButton = {minusButtonBox.x + 5, 4, minusButtonSurface->w, minusButtonSurface->h};
+    SDL_RenderCopy(renderer, minusButtonTexture, nullptr, &minusButton);
+    SDL_FreeSurface(minusButtonSurface);
+    SDL_DestroyTexture(minusButtonTexture);
+
+    // Size Button
+    SDL_RenderDrawRect(renderer, &sizeButtonBox);
+
+    SDL_Surface* sizeButtonSurface = TTF_RenderText_Blended(font, "Size", UIColor[currentTheme]);
+    SDL_Texture* sizeButtonTexture = SDL_CreateTextureFromSurface(renderer, sizeButtonSurface);
+    SDL_Rect sizeButton = {sizeButtonBox.x + 5, 4, sizeButtonSurface->w, sizeButtonSurface->h};
+    SDL_RenderCopy(renderer, sizeButtonTexture, nullptr, &sizeButton);
+    SDL_FreeSurface(sizeButtonSurface);
+    SDL_DestroyTexture(sizeButtonTexture);
+
+    // Plus Button
+    SDL_RenderDrawRect(renderer, &plusButtonBox);
+
+    SDL_Surface* plusButtonSurface = TTF_RenderText_Blended(font, "+", UIColor[currentTheme]);
+    SDL_Texture* plusButtonTexture = SDL_CreateTextureFromSurface(renderer, plusButtonSurface);
+    SDL_Rect plusButton = {plusButtonBox.x + 5, 4, plusButtonSurface->w, plusButtonSurface->h};
+    SDL_RenderCopy(renderer, plusButtonTexture, nullptr, &plusButton);
+    SDL_FreeSurface(plusButtonSurface);
+    SDL_DestroyTexture(plusButtonTexture);
+
+    #pragma endregion
+
+    #pragma region THEME BUTTON
+    // Logo
+    SDL_RenderCopy(renderer, themesIcons[currentTheme], nullptr, &themeButtonBox);
+
+    //  Box
+    SDL_RenderDrawRect(renderer, &themeButtonBox);
+
+    #pragma endregion
+
+    // Draw Editor name
+    std::string name = viewerMode ? "Ogmios Viewer (" + viewerStatus() + ")" : "Ogmios Editor";
+    if (following) {
+        name += " - following";
+    }
+    SDL_Surface* nameSurface = TTF_RenderText_Blended(font, name.c_str(), UIColor[currentTheme]);
+    SDL_Texture* nameTexture = SDL_CreateTextureFromSurface(renderer, nameSurface);
+    SDL_Rect nameRect = {themeButtonBox.x - nameSurface->w - 5, 4, nameSurface->w, nameSurface->h};
+    SDL_RenderCopy(renderer, nameTexture, nullptr, &nameRect);
+    SDL_FreeSurface(nameSurface);
+    SDL_DestroyTexture(nameTexture);
+
+    #pragma region TABS
+    // Between the size buttons and the editor name, as many as fit
+    tabBoxes.clear();
+    int tabX = plusButtonBox.x + plusButtonBox.w + BUTTON_SPAN * 3;
+    for (int k = 0; k < static_cast<int>(buffers.size()); k++) {
+        std::string label = bufferName(k);
+        SDL_Surface* tabSurface = TTF_RenderText_Blended(font, label.c_str(), UIColor[currentTheme]);
+        SDL_Rect tabBox = {tabX, BUTTON_SPAN, tabSurface->w + BUTTON_SPAN * 2, UI.h - 10};
+        if (tabBox.x + tabBox.w > nameRect.x - BUTTON_SPAN) {
+            SDL_FreeSurface(tabSurface);
+            break;
+        }
+
+        if (k == activeBuffer) {
+            SDL_SetRenderDrawColor(renderer, selectionColor[currentTheme].r, selectionColor[currentTheme].g, selectionColor[currentTheme].b, selectionColor[currentTheme].a);
+            SDL_RenderFillRect(renderer, &tabBox);
+            SDL_SetRenderDrawColor(renderer, UIColor[currentTheme].r, UIColor[currentTheme].g, UIColor[currentTheme].b, UIColor[currentTheme].a);
+        }
+        SDL_RenderDrawRect(renderer, &tabBox);
+
+        SDL_Texture* tabTexture = SDL_CreateTextureFromSurface(renderer, tabSurface);
+        SDL_Rect tabLabel = {tabBox.x + BUTTON_SPAN, 4, tabSurface->w, tabSurface->h};
+        SDL_RenderCopy(renderer, tabTexture, nullptr, &tabLabel);
+        SDL_FreeSurface(tabSurface);
+        SDL_DestroyTexture(tabTexture);
+
+        tabBoxes.push_back(tabBox);
+        tabX += tabBox.w + BUTTON_SPAN;
+    }
+    #pragma endregion
+
+    // Draw UI Border
+    SDL_RenderDrawLine(renderer, 0, UI.h, windowWidth, UI.h);
+
+    #pragma region SEARCH BAR
+    if (searchActive) {
+        SDL_SetRenderDrawColor(renderer, UIBackgroundColor[currentTheme].r, UIBackgroundColor[currentTheme].g, UIBackgroundColor[currentTheme].b, UIBackgroundColor[currentTheme].a);
+        SDL_RenderFillRect(renderer, &searchBox);
+        SDL_SetRenderDrawColor(renderer, UIColor[currentTheme].r, UIColor[currentTheme].g, UIColor[currentTheme].b, UIColor[currentTheme].a);
+        SDL_RenderDrawLine(renderer, 0, searchBox.y, windowWidth, searchBox.y);
+
+        std::string label = (searchRegexMode ? "Find (regex): " : "Find: ") + searchQuery + (replaceFocused ? "" : "|");
+        if (replaceActive) {
+            label += "   Replace: " + replaceQuery + (replaceFocused ? "|" : "");
+        }
+        label += searchError ? "   (invalid pattern)" : "   (" + std::to_string(searchMatchCount) + " matches)";
+        SDL_Surface* searchSurface = TTF_RenderText_Blended(font, label.c_str(), UIColor[currentTheme]);
+        SDL_Texture* searchTexture = SDL_CreateTextureFromSurface(renderer, searchSurface);
+        SDL_Rect searchLabel = {BUTTON_SPAN * 2, searchBox.y + 4, searchSurface->w, searchSurface->h};
+        SDL_RenderCopy(renderer, searchTexture, nullptr, &searchLabel);
+        SDL_FreeSurface(searchSurface);
+        SDL_DestroyTexture(searchTexture);
+    }
+    #pragma endregion
+
+    #pragma region STATUS BAR
+    if (!viewerMode) {
+        SDL_SetRenderDrawColor(renderer, UIBackgroundColor[currentTheme].r, UIBackgroundColor[currentTheme].g, UIBackgroundColor[currentTheme].b, UIBackgroundColor[currentTheme].a);
+        SDL_RenderFillRect(renderer, &statusBox);
+        SDL_SetRenderDrawColor(renderer, UIColor[currentTheme].r, UIColor[currentTheme].g, UIColor[currentTheme].b, UIColor[currentTheme].a);
+        SDL_RenderDrawLine(renderer, 0, statusBox.y, windowWidth, statusBox.y);
+
+        TextStats total = documentStats();
+        std::string status = "Ln " + std::to_string(cursorY + 1) + ", Col " + std::to_string(columnOf(lines[cursorY], cursorX) + 1);
+        status += "   " + std::to_string(lines.size()) + " lines, " + std::to_string(total.words) + " words, " + std::to_string(total.chars) + " chars";
+        if (hasSelection()) {
+            int startX, startY, endX, endY;
+            selectionBounds(startX, startY, endX, endY);
+            TextStats selected = rangeStats(startX, startY, endX, endY);
+            status += "   Selected: " + std::to_string(endY - startY + 1) + " lines, " + std::to_string(selected.words) + " words, " + std::to_string(selected.chars) + " chars";
+        }
+
+        SDL_Surface* statusSurface = TTF_RenderText_Blended(font, status.c_str(), UIColor[currentTheme]);
+        SDL_Texture* statusTexture = SDL_CreateTextureFromSurface(renderer, statusSurface);
+        SDL_Rect statusLabel = {BUTTON_SPAN * 2, statusBox.y + 1, statusSurface->w, statusSurface->h};
+        SDL_RenderCopy(renderer, statusTexture, nullptr, &statusLabel);
+        SDL_FreeSurface(statusSurface);
+        SDL_DestroyTexture(statusTexture);
+    }
+    #pragma endregion
+
+    TTF_SetFontSize(font, currentFontSize);
+}
+
+
+#pragma region SPLITS
+void storeView() {
+    View& view = views[currentView];
+    view.cursorX = cursorX;
+    view.cursorY = cursorY;
+    view.topLine = lineAtVisual(scrollPosition);
+    view.topRow = scrollPosition - rowOfLine(view.topLine);
+    view.topPixels = scrollPixels;
+    view.scrollVelocity = scrollVelocity;
+    view.selectionActive = selectionActive;
+    view.anchorX = anchorX;
+    view.anchorY = anchorY;
+    view.extraCarets = std::move(extraCarets);
+    extraCarets.clear();
+}
+
+// Positions the edits of the other views left past the end are pulled back onto the document
+void restoreView(int k) {
+    currentView = k;
+    View& view = views[k];
+    viewFrame = view.frame;
+    useLayoutWidth(wrapWidth(viewFrame));
+
+    int last = static_cast<int>(lines.size()) - 1;
+    auto clampX = [](int x, int y) { return std::min(x, static_cast<int>(lines[y].size())); };
+
+    cursorY = visibleLineAt(std::min(view.cursorY, last));  // a fold made in another view may hide it
+    cursorX = clampX(view.cursorX, cursorY);
+    selectionActive = view.selectionActive;
+    anchorY = std::min(view.anchorY, last);
+    anchorX = clampX(view.anchorX, anchorY);
+    extraCarets = std::move(view.extraCarets);
+    view.extraCarets.clear();
+    for (Caret& c : extraCarets) {
+        c.y = std::min(c.y, last);
+        c.x = clampX(c.x, c.y);
+        c.anchorY = std::min(c.anchorY, last);
+        c.anchorX = clampX(c.anchorX, c.anchorY);
+    }
+
+    int top = visibleLineAt(std::min(view.topLine, last));
+    scrollPosition = rowOfLine(top) + std::min(view.topRow, rowCount(top) - 1);
+    scrollPixels = view.topPixels;
+    scrollVelocity = view.scrollVelocity;
+
+    updateRenderCursorY();
+    updateRenderCursorX();
+}
+
+void switchView(int k) {
+    if (k == currentView) {
+        return;
+    }
+    storeView();
+    restoreView(k);
+}
+
+// Frames from the shares, so a resize keeps the proportions
+void placeViews() {
+    for (View& view : views) {
+        int x0 = editorArea.x + static_cast<int>(std::lround(view.x * editorArea.w));
+        int x1 = editorArea.x + static_cast<int>(std::lround((view.x + view.w) * editorArea.w));
+        int y0 = editorArea.y + static_cast<int>(std::lround(view.y * editorArea.h));
+        int y1 = editorArea.y + static_cast<int>(std::lround((view.y + view.h) * editorArea.h));
+        view.frame = {x0, y0, x1 - x0, y1 - y0};
+    }
+}
+
+// Lays the views out again with view `k` in the globals and focused, the globals must be stored
+void showViews(int k) {
+    placeViews();
+    restoreView(k);
+    focusedView = k;
+
+    std::vector<int> widths;
+    for (const View& view : views) {
+        widths.push_back(wrapWidth(view.frame));
+    }
+    dropLayoutCaches(widths);
+}
 
-    SDL_Surface* minusButtonSurface = TTF_RenderText_Blended(font, "-", UIColor[currentTheme]);
-    SDL_Texture* minusButtonTexture = SDL_CreateTextureFromSurface(renderer, minusButtonSurface);
-    SDL_Rect minusButton = {minusButtonBox.x + 5, 4, minusButtonSurface->w, minusButtonSurface->h};
-    SDL_RenderCopy(renderer, minusButtonTexture, nullptr, &minusButton);
-    SDL_FreeSurface(minusButtonSurface);
-    SDL_DestroyTexture(minusButtonTexture);
+void arrangeViews() {
+    storeView();
+    showViews(currentView);
+}
 
-    // Size Button
-    SDL_RenderDrawRect(renderer, &sizeButtonBox);
+void focusView(int k) {
+    if (k == focusedView) {
+        return;
+    }
+    mouseSelecting = false;
+    switchView(k);
+    focusedView = k;
+}
 
-    SDL_Surface* sizeButtonSurface = TTF_RenderText_Blended(font, "Size", UIColor[currentTheme]);
-    SDL_Texture* sizeButtonTexture = SDL_CreateTextureFromSurface(renderer, sizeButtonSurface);
-    SDL_Rect sizeButton = {sizeButtonBox.x + 5, 4, sizeButtonSurface->w, sizeButtonSurface->h};
-    SDL_RenderCopy(renderer, sizeButtonTexture, nullptr, &sizeButton);
-    SDL_FreeSurface(sizeButtonSurface);
-    SDL_DestroyTexture(sizeButtonTexture);
+// Halves the focused view, the new half gets the focus with the same cursor and scroll
+void splitView(bool sideBySide) {
+    SDL_Rect halfFrame = views[focusedView].frame;
+    if (sideBySide) {
+        halfFrame.w /= 2;
+    } else {
+        halfFrame.h /= 2;
+    }
+    if (wrapWidth(halfFrame) < VIEW_MIN_TEXT_WIDTH || halfFrame.h < lineHeight * VIEW_MIN_ROWS) {
+        return;
+    }
 
-    // Plus Button
-    SDL_RenderDrawRect(renderer, &plusButtonBox);
+    storeView();
+    View& view = views[focusedView];
+    if (sideBySide) {
+        view.w /= 2;
+    } else {
+        view.h /= 2;
+    }
+    View half = view;
+    if (sideBySide) {
+        half.x += half.w;
+    } else {
+        half.y += half.h;
+    }
+    views.push_back(half);
 
-    SDL_Surface* plusButtonSurface = TTF_RenderText_Blended(font, "+", UIColor[currentTheme]);
-    SDL_Texture* plusButtonTexture = SDL_CreateTextureFromSurface(renderer, plusButtonSurface);
-    SDL_Rect plusButton = {plusButtonBox.x + 5, 4, plusButtonSurface->w, plusButtonSurface->h};
-    SDL_RenderCopy(renderer, plusButtonTexture, nullptr, &plusButton);
-    SDL_FreeSurface(plusButtonSurface);
-    SDL_DestroyTexture(plusButtonTexture);
+    mouseSelecting = false;
+    showViews(static_cast<int>(views.size()) - 1);
+}
 
-    #pragma endregion
+// The views along one side of the closed one that cover that whole side grow over it
+void closeView() {
+    if (views.size() == 1) {
+        return;
+    }
 
-    #pragma region THEME BUTTON
-    // Logo
-    SDL_RenderCopy(renderer, themesIcons[currentTheme], nullptr, &themeButtonBox);
+    const double epsilon = 1e-9;
+    View closed = std::move(views[focusedView]);
+    views.erase(views.begin() + focusedView);
+
+    int heir = -1;
+    for (int side = 0; side < 4 && heir < 0; side++) {
+        bool across = side < 2;     // left or right of the closed view
+        std::vector<int> touching;
+        double covered = 0;
+        for (int k = 0; k < static_cast<int>(views.size()); k++) {
+            const View& v = views[k];
+            bool within = across ? v.y >= closed.y - epsilon && v.y + v.h <= closed.y + closed.h + epsilon
+                                 : v.x >= closed.x - epsilon && v.x + v.w <= closed.x + closed.w + epsilon;
+            double gap = side == 0 ? v.x + v.w - closed.x
+                       : side == 1 ? v.x - closed.x - closed.w
+                       : side == 2 ? v.y + v.h - closed.y
+                       : v.y - closed.y - closed.h;
+            if (within && std::fabs(gap) < epsilon) {
+                touching.push_back(k);
+                covered += across ? v.h : v.w;
+            }
+        }
+        if (touching.empty() || std::fabs(covered - (across ? closed.h : closed.w)) > epsilon) {
+            continue;
+        }
 
-    //  Box
-    SDL_RenderDrawRect(renderer, &themeButtonBox);
+        for (int k : touching) {
+            View& v = views[k];
+            if (side == 1) {
+                v.x = closed.x;
+            }
+            if (side == 3) {
+                v.y = closed.y;
+            }
+            if (across) {
+                v.w += closed.w;
+            } else {
+                v.h += closed.h;
+            }
+        }
+        heir = touching[0];
+    }
 
-    #pragma endregion
+    mouseSelecting = false;
+    showViews(std::max(heir, 0));
+}
 
-    // Draw Editor name
-    SDL_Surface* nameSurface = TTF_RenderText_Blended(font, "Ogmios Editor", UIColor[currentTheme]);
-    SDL_Texture* nameTexture = SDL_CreateTextureFromSurface(renderer, nameSurface);
-    SDL_Rect nameRect = {themeButtonBox.x - nameSurface->w - 5, 4, nameSurface->w, nameSurface->h};
-    SDL_RenderCopy(renderer, nameTexture, nullptr, &nameRect);
-    SDL_FreeSurface(nameSurface);
-    SDL_DestroyTexture(nameTexture);
+void cycleViews(int step) {
+    int count = static_cast<int>(views.size());
+    focusView((focusedView + step + count) % count);
+}
 
-    // Draw UI Border
-    SDL_RenderDrawLine(renderer, 0, UI.h, windowWidth, UI.h);
+// Ctrl+\ splits side by side, Ctrl+Shift+\ one above the other, Ctrl+Shift+W closes
+// the focused view and F6 / Shift+F6 moves the focus
+bool handleViewEvents(SDL_Keycode key) {
+    if (viewerMode) {
+        return false;
+    }
 
-    TTF_SetFontSize(font, currentFontSize);
+    bool ctrl = SDL_GetModState() & KMOD_CTRL;
+    bool shift = SDL_GetModState() & KMOD_SHIFT;
+    if (key == SDLK_BACKSLASH && ctrl) {
+        splitView(!shift);
+        return true;
+    }
+    if (key == SDLK_w && ctrl && shift && views.size() > 1) {
+        closeView();
+        return true;
+    }
+    if (key == SDLK_F6 && views.size() > 1) {
+        cycleViews(shift ? -1 : 1);
+        return true;
+    }
+    return false;
+}
+
+// The wheel scrolls the view under the mouse without focusing it
+void flingViewAt(int x, int y, double notches) {
+    int k = viewAt(x, y);
+    if (k < 0 || k == focusedView) {
+        flingScroll(notches);
+        return;
+    }
+    switchView(k);
+    flingScroll(notches);
+    switchView(focusedView);
+}
+
+// The focused view last, so the globals are back on it for the input and the UI.
+// `seconds` since the last frame move the views still gliding
+void renderViews(double seconds) {
+    for (int pass = 0; pass < static_cast<int>(views.size()); pass++) {
+        int k = (focusedView + 1 + pass) % static_cast<int>(views.size());
+        switchView(k);
+        glideScroll(seconds);
+        layoutVisibleLines();
+        updateScrollBar();
+        renderText();
+        renderCursor();
+        renderMinimap();
+        if (k != focusedView) {
+            renderScrollBar();
+        }
+    }
+
+    if (views.size() > 1) {
+        SDL_SetRenderDrawColor(renderer, 51, 51, 51, 255);
+        for (const View& view : views) {
+            SDL_RenderDrawRect(renderer, &view.frame);
+        }
+        SDL_SetRenderDrawColor(renderer, cursorColor[currentTheme].r, cursorColor[currentTheme].g, cursorColor[currentTheme].b, cursorColor[currentTheme].a);
+        SDL_RenderDrawRect(renderer, &views[focusedView].frame);
+    }
 }
+#pragma endregion
 
 
 void handleTextEditorEvents(SDL_Keycode key) {
+    if (finderActive) {
+        handleFinderEvents(key);
+        return;
+    }
+    if (handleViewEvents(key)) {
+        return;
+    }
+    if (handleTabEvents(key)) {
+        return;
+    }
+    if (browserActive) {
+        handleBrowserEvents(key);
+        return;
+    }
+    if (viewerMode && handleViewerEvents(key)) {
+        return;
+    }
+    if (searchActive && handleSearchEvents(key)) {
+        return;
+    }
+    if (extraCarets.size() && handleMultiCursorEvents(key)) {
+        return;
+    }
+
+    bool shift = SDL_GetModState() & KMOD_SHIFT;
+
     switch (key) {
         case SDLK_UP:
+            prepareSelection(shift);
             moveCursorUp();
             break;
         case SDLK_DOWN:
+            prepareSelection(shift);
             moveCursorDown();
             break;
         case SDLK_LEFT:
+            prepareSelection(shift);
             moveCursorLeft();
             break;
         case SDLK_RIGHT:
+            prepareSelection(shift);
             moveCursorRight();
             break;
         case SDLK_HOME:
+            prepareSelection(shift);
             jumpToLineStart();
             break;
         case SDLK_END:
+            prepareSelection(shift);
             jumpToLineEnd();
             break;
         case SDLK_PAGEUP:
+            prepareSelection(shift);
             jumpToFileStart();
             break;
         case SDLK_PAGEDOWN:
+            prepareSelection(shift);
             jumpToFileEnd();
             break;   
         case SDLK_BACKSPACE:        // SUPPR CHAR
-            if (!deleteCurrentLine()) {
+            if (!deleteSelection() && !deleteCurrentLine()) {
                 deletePreviousChar();
             }
             break;
         case SDLK_DELETE:
-            if (!deleteNextLine()) {
+            if (!deleteSelection() && !deleteNextLine()) {
                 deleteNextChar();
             }
             break;
         case SDLK_RETURN:           // NEW LINE
-            insertNewLine();
+            replaceSelection(insertNewLine);
             break;
         case SDLK_TAB:
-            insertTab();
+            replaceSelection(insertTab);
+            break;
+        case SDLK_a:                // SELECT ALL
+            if (SDL_GetModState() & KMOD_CTRL) {
+                selectAll();
+            }
             break;
         case SDLK_c:                // COPY
             if (SDL_GetModState() & KMOD_CTRL) {
-                SDL_SetClipboardText(lines[cursorY].c_str());
+                copy();
+            }
+            break;
+        case SDLK_d:                // ADD CURSOR ON NEXT OCCURRENCE
+            if (SDL_GetModState() & KMOD_CTRL) {
+                selectNextOccurrence();
+            }
+            break;
+        case SDLK_x:                // CUT
+            if (SDL_GetModState() & KMOD_CTRL) {
+                cut();
             }
             break;
         case SDLK_v:                // PASTE
             if (SDL_GetModState() & KMOD_CTRL) {
-                lines[cursorY].append(SDL_GetClipboardText());
+                replaceSelection(paste);
             }
             break;
         case SDLK_s:
@@ -673,11 +7243,89 @@ void handleTextEditorEvents(SDL_Keycode key) {
                 load();
             }
             break;
+        case SDLK_f:                // FIND
+            if (SDL_GetModState() & KMOD_CTRL) {
+                openSearch(false);
+            }
+            break;
+        case SDLK_h:                // REPLACE
+            if (SDL_GetModState() & KMOD_CTRL) {
+                openSearch(true);
+            }
+            break;
+        case SDLK_z:                // UNDO / REDO
+            if (SDL_GetModState() & KMOD_CTRL) {
+                if (SDL_GetModState() & KMOD_SHIFT) {
+                    redo();
+                } else {
+                    undo();
+                }
+            }
+            break;
+        case SDLK_y:
+            if (SDL_GetModState() & KMOD_CTRL) {
+                redo();
+            }
+            break;
+        case SDLK_p:                // GO TO FILE
+            if (SDL_GetModState() & KMOD_CTRL) {
+                openFinder();
+            }
+            break;
+        case SDLK_LEFTBRACKET:      // FOLD / UNFOLD
+        case SDLK_RIGHTBRACKET:
+            if ((SDL_GetModState() & KMOD_CTRL) && (SDL_GetModState() & KMOD_SHIFT)) {
+                if (key == SDLK_LEFTBRACKET) {
+                    foldAtCursor();
+                } else {
+                    unfoldAtCursor();
+                }
+            }
+            break;
+        case SDLK_m:                // MATCHING BRACKET
+            if (SDL_GetModState() & KMOD_CTRL) {
+                jumpToMatchingBracket();
+            }
+            break;
+        case SDLK_t:                // TAIL / FOLLOW
+            if (SDL_GetModState() & KMOD_CTRL) {
+                toggleFollow();
+            }
+            break;
+        case SDLK_F3:
+            jumpToSearchMatch(SDL_GetModState() & KMOD_SHIFT);
+            break;
         default:
             break;
     }
 }
 
+bool inEditor(int x, int y) {
+    SDL_Point point = {x, y};
+    return SDL_PointInRect(&point, &viewFrame);
+}
+
+// Puts the cursor on the char closest to the window point (x, y)
+void moveCursorTo(int x, int y) {
+    int row = (y - viewFrame.y + static_cast<int>(scrollPixels)) / lineHeight + scrollPosition;
+
+    if (row < visualLineCount()) {
+        int lineIndex = lineAtVisual(row);
+        int j = row - rowOfLine(lineIndex);
+        int start = sublineStart(lineIndex, j);
+        std::string subline = lines[lineIndex].substr(start, sublineEnd(lineIndex, j) - start);
+
+        cursorX = start + charIndexAt(subline, x - viewFrame.x - editorLeftMargin);
+        cursorY = lineIndex;
+
+        updateRenderCursorY();
+        updateRenderCursorX();
+    }
+    else {
+        jumpToFileEnd();
+    }
+}
+
 void handleUIEvents() {
     SDL_Point mousePos;
     SDL_GetMouseState(&mousePos.x, &mousePos.y);
@@ -706,45 +7354,60 @@ void handleUIEvents() {
     else if (SDL_PointInRect(&mousePos, &themeButtonBox)) {
         updateTheme();
     }
+    // Tab Event
+    else if (tabAt(mousePos) >= 0) {
+        switchBuffer(tabAt(mousePos));
+    }
     //  Move mouse in editor
-    else if (mousePos.y >= UI.h && mousePos.y < windowHeight && mousePos.x >= 0 && mousePos.x < windowWidth) {
-        int lineIndex = (mousePos.y - UI.h) / lineHeight;
-        
-        if (lineIndex < static_cast<int>(lines.size())) {
-            int w,h;
-            TTF_SizeText(font, lines[lineIndex].c_str(), &w, &h);
-
-            int charPos = 0;
-            int width = 0;
-            for (char c : lines[lineIndex]) {
-                int charW, charH;
-                TTF_SizeText(font, &c, &charW, &charH);
-                
-                if (width + charW / 2 > mousePos.x) {
-                    break;
-                }
+    else if (!browserActive && !finderActive && inEditor(mousePos.x, mousePos.y)) {
+        moveCursorTo(mousePos.x, mousePos.y);
+    }
+}
 
-                width += charW;
-                charPos++;
-            }
+// Left click places the cursor and starts a drag selection, Shift+click extends the current one
+// and Ctrl+click adds another cursor
+void handleEditorPress(int x, int y) {
+    if (viewerMode || viewAt(x, y) < 0) {
+        return;
+    }
+    focusView(viewAt(x, y));
 
-            cursorX = charPos;
-            cursorY = lineIndex;
-        }
-        else {
-            jumpToFileEnd();
-        }
-        
+    if (inMinimap(x, y)) {
+        jumpToMinimap(y);
+        minimapDragging = true;
+        return;
     }
+
+    if (SDL_GetModState() & KMOD_CTRL) {
+        addCaret(cursorX, cursorY);
+    } else {
+        clearExtraCarets();
+    }
+
+    bool extend = SDL_GetModState() & KMOD_SHIFT;
+    prepareSelection(extend);
+    moveCursorTo(x, y);
+    startSelection();
+    mouseSelecting = true;
 }
 
+void handleEditorDrag(int x, int y) {
+    y = std::max(viewFrame.y, std::min(y, viewFrame.y + viewFrame.h - 1));
+    moveCursorTo(x, y);
+    scrollToCursor();
+}
+
+// A view whose width changed is laid out at the new one like any other width, see useLayoutWidth()
 void resizeWindow(int w, int h) {
     windowWidth = w;
     windowHeight = h;
 
     updateRects();
+    arrangeViews();
 }
 
+std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+
 bool loop() {
     bool looping = true;
 
@@ -760,18 +7423,80 @@ bool loop() {
                 }
                 break;
             case SDL_TEXTINPUT:
-                insertChar(*event.text.text);
+                if (finderActive) {
+                    typeInFinder(event.text.text);
+                    break;
+                }
+                if (browserActive) {
+                    typeInBrowser(event.text.text);
+                    break;
+                }
+                if (viewerMode) {
+                    break;
+                }
+                if (searchActive && replaceFocused) {
+                    replaceQuery += event.text.text;
+                }
+                else if (searchActive) {
+                    searchQuery += event.text.text;
+                    startSearch();
+                } else if (extraCarets.size()) {
+                    editAtCarets(event.text.text, strlen(event.text.text), 0);
+                } else {
+                    replaceSelection([&event] { insertChar(*event.text.text); });
+                }
                 break;
             case SDL_KEYDOWN:
                 handleTextEditorEvents(event.key.keysym.sym);
                 break;
+            case SDL_MOUSEBUTTONDOWN:
+                if (event.button.button == SDL_BUTTON_LEFT && finderActive) {
+                    handleFinderPress(event.button.y);
+                }
+                else if (event.button.button == SDL_BUTTON_LEFT && browserActive) {
+                    handleBrowserPress(event.button.y);
+                }
+                else if (event.button.button == SDL_BUTTON_LEFT) {
+                    handleEditorPress(event.button.x, event.button.y);
+                }
+                break;
+            case SDL_MOUSEMOTION:
+                if (mouseSelecting) {
+                    handleEditorDrag(event.motion.x, event.motion.y);
+                }
+                else if (minimapDragging) {
+                    jumpToMinimap(event.motion.y);
+                }
+                break;
             case SDL_MOUSEBUTTONUP:
-                handleUIEvents();
+                if (mouseSelecting) {
+                    mouseSelecting = false;
+                }
+                else if (minimapDragging) {
+                    minimapDragging = false;
+                } else {
+                    handleUIEvents();
+                }
                 break;
             case SDL_MOUSEWHEEL:
-                scroll(-event.wheel.y);
+                if (finderActive) {
+                    scrollFinder(-event.wheel.y * 3);
+                }
+                else if (browserActive) {
+                    scrollBrowser(-event.wheel.y * 3);
+                }
+                else if (viewerMode) {
+                    scrollViewer(-event.wheel.y * 3);
+                } else {
+                    SDL_Point mousePos;
+                    SDL_GetMouseState(&mousePos.x, &mousePos.y);
+                    flingViewAt(mousePos.x, mousePos.y, event.wheel.preciseY != 0 ? -event.wheel.preciseY : -event.wheel.y);
+                }
                 break;
             default:
+                if (event.type == dialogEvent) {
+                    handleDialogEvent(event.user);
+                }
                 break;
         }
     }
@@ -779,13 +7504,33 @@ bool loop() {
     SDL_SetRenderDrawColor(renderer, textBackgroundColor[currentTheme].r, textBackgroundColor[currentTheme].g, textBackgroundColor[currentTheme].b, textBackgroundColor[currentTheme].a);
     SDL_RenderClear(renderer);
 
-    updateScrollBar();
-    
-    renderText();
-    renderCursor();
+    applyLoadedLines();
+    applyBrowserEntries();
+    updateFinder();
+    updateFollow();
+    updateExternalChanges();
+    applyLayoutResults();
+    updateMinimap();
+    applySearchResults();
+    lexUpTo(static_cast<int>(lines.size()) - 1, LEX_LINES_PER_FRAME);
+    if (viewerMode) {
+        updateViewerScrollBar();
+        renderViewer();
+    } else {
+        auto now = std::chrono::steady_clock::now();
+        renderViews(std::min(0.1, std::chrono::duration<double>(now - lastFrame).count()));
+        lastFrame = now;
+    }
+    if (browserActive) {
+        renderBrowser();
+    }
+    if (finderActive) {
+        renderFinder();
+    }
     renderUI();
     
     SDL_RenderPresent(renderer);
+    trimTextCache();
     
     return looping;
 }
@@ -793,6 +7538,19 @@ bool loop() {
 void kill() {
     SDL_StopTextInput();
 
+    stopJournal(true);
+    stopFollowing();
+    closeViewer();
+    stopBrowserScan();
+    stopFinder();
+    closeDialogs();
+
+    layoutGeneration++;
+    searchGeneration++;
+    pool.reset();
+
+    clearTextCache();
+    SDL_DestroyTexture(minimapTexture);
     for (int i = 0; i < numberOfThemes; i++) {
         SDL_DestroyTexture(themesIcons[i]);
     }
@@ -805,9 +7563,239 @@ void kill() {
     std::cout << "Window killed!" << std::endl;
 }
 
+#pragma region BATCH
+// `ogmios --batch SCRIPT [FILE] [--time]` applies SCRIPT to FILE (or stdin) without opening a window,
+// through the same edit, undo and search code as the editor. One command per line:
+//   goto LINE [COLUMN]              insert TEXT                 insert-line LINE TEXT
+//   delete-lines FIRST [LAST]       replace TEXT => TEXT        replace-regex PATTERN => TEXT
+//   count TEXT                      undo                        redo
+//   save [PATH]
+// Lines and columns are 1-based, TEXT understands \n, \t and \\. The document is written to stdout
+// unless the script saved it, --time reports how long each command took on stderr.
+void initHeadless() {
+    monospaceFont = true;
+    monospaceAdvance = 1;
+    windowWidth = WINDOW_WIDTH_DEFAULT;
+    windowHeight = WINDOW_HEIGHT_DEFAULT;
+    lineHeight = DEFAULT_LINE_HEIGHT;
+    layoutWidth = INT_MAX / 2;
+    visualLineStart.assign(1, 0);
+
+    pool = std::make_unique<ThreadPool>(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    initRects();
+}
+
+std::string unescape(const std::string& text) {
+    std::string result;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            char c = text[++i];
+            result += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+        } else {
+            result += text[i];
+        }
+    }
+    return result;
+}
+
+// Line number argument, false when it is not a number within [1, limit]
+bool parseLine(const std::string& text, int limit, int& line) {
+    char* end;
+    long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < 1 || value > limit) {
+        return false;
+    }
+    line = static_cast<int>(value) - 1;
+    return true;
+}
+
+// Runs one command, returns an error message or an empty string
+std::string runBatchCommand(const std::string& command, const std::string& argument, bool& saved) {
+    int lineCount = static_cast<int>(lines.size());
+
+    if (command == "goto") {
+        std::istringstream in(argument);
+        std::string line, column = "1";
+        in >> line >> column;
+        int y, x;
+        if (!parseLine(line, lineCount, y)) {
+            return "no line " + line;
+        }
+        if (!parseLine(column, static_cast<int>(lines[y].size()) + 1, x)) {
+            return "no column " + column;
+        }
+        clearSelection();
+        clearExtraCarets();
+        cursorY = y;
+        cursorX = x;
+        updateRenderCursorX();
+    }
+    else if (command == "insert") {
+        std::string text = unescape(argument);
+        insertText(text.data(), text.size());
+    }
+    else if (command == "insert-line") {
+        size_t space = argument.find(' ');
+        int y;
+        if (!parseLine(argument.substr(0, space), lineCount + 1, y)) {
+            return "no line " + argument.substr(0, space);
+        }
+        beginEdit(y, 0);
+        lines.insert(lines.begin() + y, space == std::string::npos ? "" : unescape(argument.substr(space + 1)));
+        endEdit(1);
+    }
+    else if (command == "delete-lines") {
+        std::istringstream in(argument);
+        std::string first, last;
+        in >> first >> last;
+        int from, to;
+        if (!parseLine(first, lineCount, from) || !parseLine(last.empty() ? first : last, lineCount, to) || to < from) {
+            return "bad line range " + argument;
+        }
+        beginEdit(from, to - from + 1);
+        lines.erase(lines.begin() + from, lines.begin() + to + 1);
+        bool emptied = lines.empty();
+        if (emptied) {
+            lines.push_back("");
+        }
+        endEdit(emptied ? 1 : 0);
+        cursorY = std::min(cursorY, static_cast<int>(lines.size()) - 1);
+        cursorX = std::min(cursorX, static_cast<int>(lines[cursorY].size()));
+    }
+    else if (command == "replace" || command == "replace-regex") {
+        size_t arrow = argument.find(" => ");
+        if (arrow == std::string::npos) {
+            return "expected PATTERN => REPLACEMENT";
+        }
+        searchRegexMode = command == "replace-regex";
+        searchQuery = searchRegexMode ? argument.substr(0, arrow) : unescape(argument.substr(0, arrow));
+        replaceQuery = unescape(argument.substr(arrow + 4));
+        if (searchQuery.empty()) {
+            return "empty pattern";
+        }
+        std::shared_ptr<const Regex> regex;
+        if (!compileQuery(regex)) {
+            return "invalid regex " + searchQuery;
+        }
+        replaceAll();
+    }
+    else if (command == "count") {
+        std::string query = unescape(argument);
+        long long count = 0;
+        for (const std::string& line : lines) {
+            for (size_t found = line.find(query); !query.empty() && found != std::string::npos; found = line.find(query, found + query.size())) {
+                count++;
+            }
+        }
+        std::cerr << count << std::endl;
+    }
+    else if (command == "undo") {
+        undo();
+    }
+    else if (command == "redo") {
+        redo();
+    }
+    else if (command == "save") {
+        std::string path = argument.empty() ? documentPath : argument;
+        if (path.empty() || !writeDocument(path)) {
+            return "cannot save to " + (path.empty() ? std::string("stdin") : path);
+        }
+        saved = true;
+    }
+    else {
+        return "unknown command " + command;
+    }
+    return "";
+}
+
+int runBatch(const std::string& scriptPath, const std::string& path, bool timed) {
+    std::ifstream script(scriptPath);
+    if (!script) {
+        std::cerr << "Cannot open the script " << scriptPath << std::endl;
+        return 1;
+    }
+
+    initHeadless();
+    beginEdit(0, static_cast<int>(lines.size()), false);
+    if (path.empty()) {
+        readLines(std::cin, lines, documentFinalNewline);
+    }
+    else if (!readDocument(path, lines, documentFinalNewline)) {
+        std::cerr << "Cannot open the file " << path << std::endl;
+        return 1;
+    }
+    endEdit(static_cast<int>(lines.size()));
+    documentPath = path;
+    jumpToFileStart();
+
+    int status = 0;
+    bool saved = false;
+    std::string line;
+    for (int number = 1; std::getline(script, line); number++) {
+        if (line.size() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t space = line.find(' ');
+        std::string command = line.substr(0, space);
+        std::string argument = space == std::string::npos ? "" : line.substr(space + 1);
+
+        auto start = std::chrono::steady_clock::now();
+        std::string error = runBatchCommand(command, argument, saved);
+        if (timed) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cerr << "line " << number << ": " << command << " " << elapsed.count() << " ms" << std::endl;
+        }
+        if (error.size()) {
+            std::cerr << scriptPath << ":" << number << ": " << error << std::endl;
+            status = 1;
+            break;
+        }
+    }
+
+    if (status == 0 && !saved) {
+        std::ostringstream out;
+        for (size_t i = 0; i < lines.size(); i++) {
+            out << lines[i];
+            if (i + 1 < lines.size() || documentFinalNewline) {
+                out << '\n';
+            }
+        }
+        std::cout << out.str();
+    }
+
+    layoutGeneration++;
+    searchGeneration++;
+    pool.reset();
+    return status;
+}
+#pragma endregion
+
+
 int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--batch") == 0) {
+        bool timed = strcmp(argv[argc - 1], "--time") == 0;
+        int files = argc - (timed ? 4 : 3);
+        if (files > 1) {
+            std::cerr << "Usage: ogmios --batch SCRIPT [FILE] [--time]" << std::endl;
+            return 1;
+        }
+        return runBatch(argv[2], files ? argv[3] : "", timed);
+    }
+
     if (init()) {
-        lines.push_back("");
+        clearEditor();
+        off_t recovered = recoverJournal();
+        startJournal(recovered);
+        if (argc >= 2 && recovered > 0) {
+            std::cout << "Unsaved edits were recovered, " << argv[1] << " was not opened" << std::endl;
+        }
+        else if (argc >= 2) {
+            openFileArgument(argv[1]);
+        }
         while (loop()) {}
         kill();
     } else {
@@ -87,6 +87,7 @@ Thanks for contributions, bug corrections & thorough testing to:
  #include <termios.h>
  #include <sys/utsname.h>
  #include <signal.h> /* on old systems try <sys/signal.h> instead */
+ #include <pthread.h>
  #define SLASH "/"
 #endif /* _WIN32 */
 
@@ -671,6 +672,11 @@ char * tinyfd_mbcsTo8(char const * aMbcsString)
 }
 
 
+void tinyfd_detectPresenceAsync(void)
+{
+}
+
+
 void tinyfd_beep(void)
 {
     if (windowsVersion() > 5) Beep(440, 300);
@@ -3271,45 +3277,245 @@ static int dirExists( char const * aDirPath )
 }
 
 
-static int detectPresence( char const * aExecutable )
+/* Every executable the dialogs below may look for. They are all probed in one
+pass (tinyfd_detectPresenceAsync) by walking $PATH with access(), without
+spawning "which", and the answers are cached on disk until PATH or one of its
+directories changes. */
+static char const * gProbedExecutables[] = {
+	"dialog", "whiptail", "bash",
+	"xterm", "terminator", "lxterminal", "konsole", "kterm", "tilix",
+	"xfce4-terminal", "mate-terminal", "Eterm", "evilvte", "pterm", "gnome-terminal",
+	"pactl", "speaker-test", "sox", "beep.exe", "beep",
+	"xmessage", "gxmessage", "gmessage", "notify-send", "perl", "afplay",
+	"Xdialog", "gdialog", "osascript", "qarma", "matedialog", "xprop",
+	"zenity", "yad", "kdialog",
+	"python3", "python3.9", "python3.8", "python3.7", "python3.6", "python3.5",
+	"python3.4", "python3.3", "python3.2", "python3.1", "python3.0",
+	"python2", "python2.9", "python2.8", "python2.7", "python2.6", "python2.5",
+	"python2.4", "python2.3", "python2.2", "python2.1", "python2.0"
+} ;
+#define PROBED_COUNT (sizeof(gProbedExecutables) / sizeof(gProbedExecutables[0]))
+
+static signed char gPresence[PROBED_COUNT] ; /* 0 absent, 1 present, anything else unknown */
+static int gPresenceKnown = 0 ;
+static pthread_mutex_t gPresenceMutex = PTHREAD_MUTEX_INITIALIZER ;
+
+
+static int probedIndex( char const * aExecutable )
 {
-   char lBuff[MAX_PATH_OR_CMD] ;
-   char lTestedString[MAX_PATH_OR_CMD] = "which " ;
-   FILE * lIn ;
+	size_t i ;
+	for ( i = 0 ; i < PROBED_COUNT ; i ++ )
+	{
+		if ( ! strcmp( gProbedExecutables[i] , aExecutable ) ) return (int) i ;
+	}
+	return -1 ;
+}
+
+
+/* what "which" did: the first executable regular file named aExecutable in $PATH */
+static int searchPath( char const * aExecutable )
+{
+	char lCandidate[MAX_PATH_OR_CMD] ;
+	char const * lDir ;
+	char const * lEnd ;
+	struct stat lInfo ;
+	int lFound = 0 ;
 #ifdef _GNU_SOURCE
-   char* lAllocatedCharString;
-   int lSubstringUndetected;
+	char* lAllocatedCharString;
 #endif
 
-   strcat( lTestedString , aExecutable ) ;
-   strcat( lTestedString, " 2>/dev/null ");
-   lIn = popen( lTestedString , "r" ) ;
-   if ( ( fgets( lBuff , sizeof( lBuff ) , lIn ) != NULL )
-    && ( ! strchr( lBuff , ':' ) ) && ( strncmp(lBuff, "no ", 3) ) )
-   {   /* present */
-      pclose( lIn ) ;
+	if ( strchr( aExecutable , '/' ) )
+	{
+		strcpy( lCandidate , aExecutable ) ;
+		lFound = ! access( lCandidate , X_OK ) && ! stat( lCandidate , & lInfo ) && S_ISREG( lInfo.st_mode ) ;
+	}
+	else
+	{
+		lDir = getenv( "PATH" ) ;
+		while ( lDir && * lDir && ! lFound )
+		{
+			lEnd = strchr( lDir , ':' ) ;
+			if ( ! lEnd ) lEnd = lDir + strlen( lDir ) ;
+			if ( lEnd > lDir && (size_t)( lEnd - lDir ) + strlen( aExecutable ) + 2 < sizeof( lCandidate ) )
+			{
+				memcpy( lCandidate , lDir , lEnd - lDir ) ;
+				lCandidate[lEnd - lDir] = '/' ;
+				strcpy( lCandidate + ( lEnd - lDir ) + 1 , aExecutable ) ;
+				lFound = ! access( lCandidate , X_OK ) && ! stat( lCandidate , & lInfo ) && S_ISREG( lInfo.st_mode ) ;
+			}
+			lDir = * lEnd ? lEnd + 1 : lEnd ;
+		}
+	}
 
 #ifdef _GNU_SOURCE /*to bypass this, just comment out "#define _GNU_SOURCE" at the top of the file*/
-      if ( lBuff[strlen( lBuff ) -1] == '\n' ) lBuff[strlen( lBuff ) -1] = '\0' ;
-      lAllocatedCharString = realpath(lBuff,NULL); /*same as canonicalize_file_name*/
-      lSubstringUndetected = ! strstr(lAllocatedCharString, aExecutable);
-      free(lAllocatedCharString);
-      if (lSubstringUndetected)
-      {
-         if (tinyfd_verbose) printf("detectPresence %s %d\n", aExecutable, 0);
-         return 0;
-      }
+	if ( lFound )
+	{
+		/* a link to another program (qarma -> zenity...) does not count */
+		lAllocatedCharString = realpath(lCandidate,NULL); /*same as canonicalize_file_name*/
+		lFound = lAllocatedCharString && strstr(lAllocatedCharString, strrchr(aExecutable, '/') ? strrchr(aExecutable, '/') + 1 : aExecutable) ;
+		free(lAllocatedCharString);
+	}
 #endif /*_GNU_SOURCE*/
 
-      if (tinyfd_verbose) printf("detectPresence %s %d\n", aExecutable, 1);
-      return 1 ;
-   }
-   else
-   {
-      pclose( lIn ) ;
-      if (tinyfd_verbose) printf("detectPresence %s %d\n", aExecutable, 0);
-      return 0 ;
-   }
+	return lFound ;
+}
+
+
+/* FNV-1a of PATH and of the modification time of each of its directories,
+so installing or removing a program invalidates the cache */
+static unsigned long long pathKey(void)
+{
+	char lDirName[MAX_PATH_OR_CMD] ;
+	char const * lPath = getenv( "PATH" ) ;
+	char const * lDir ;
+	char const * lEnd ;
+	struct stat lInfo ;
+	unsigned long long lKey = 14695981039346656037ULL ;
+	size_t i ;
+
+	for ( lDir = lPath ; lDir && * lDir ; lDir = * lEnd ? lEnd + 1 : lEnd )
+	{
+		lEnd = strchr( lDir , ':' ) ;
+		if ( ! lEnd ) lEnd = lDir + strlen( lDir ) ;
+		for ( i = 0 ; lDir + i <= lEnd ; i ++ )
+		{
+			lKey = ( lKey ^ (unsigned char) lDir[i] ) * 1099511628211ULL ;
+		}
+		if ( (size_t)( lEnd - lDir ) < sizeof( lDirName ) )
+		{
+			memcpy( lDirName , lDir , lEnd - lDir ) ;
+			lDirName[lEnd - lDir] = '\0' ;
+			if ( ! stat( lDirName , & lInfo ) )
+			{
+				lKey = ( lKey ^ (unsigned long long) lInfo.st_mtime ) * 1099511628211ULL ;
+			}
+		}
+	}
+	return lKey ;
+}
+
+
+static int presenceCachePath( char * aPath , size_t aSize )
+{
+	char const * lCacheHome = getenv( "XDG_CACHE_HOME" ) ;
+	char const * lHome = getenv( "HOME" ) ;
+	if ( lCacheHome && * lCacheHome )
+		return snprintf( aPath , aSize , "%s/tinyfiledialogs.presence" , lCacheHome ) < (int) aSize ;
+	if ( lHome && * lHome )
+		return snprintf( aPath , aSize , "%s/.cache/tinyfiledialogs.presence" , lHome ) < (int) aSize ;
+	return 0 ;
+}
+
+
+/* one line per executable: "name 0|1", after a first line holding the key */
+static int readPresenceCache( unsigned long long aKey )
+{
+	char lPath[MAX_PATH_OR_CMD] ;
+	char lLine[MAX_PATH_OR_CMD] ;
+	char lName[MAX_PATH_OR_CMD] ;
+	unsigned long long lKey ;
+	int lValue ;
+	int lIndex ;
+	int lCount = 0 ;
+	FILE * lIn ;
+
+	if ( ! presenceCachePath( lPath , sizeof( lPath ) ) || ! ( lIn = fopen( lPath , "r" ) ) ) return 0 ;
+	if ( fgets( lLine , sizeof( lLine ) , lIn ) && sscanf( lLine , "tinyfd-presence %llx" , & lKey ) == 1 && lKey == aKey )
+	{
+		while ( fgets( lLine , sizeof( lLine ) , lIn ) )
+		{
+			if ( sscanf( lLine , "%s %d" , lName , & lValue ) == 2
+			  && ( lIndex = probedIndex( lName ) ) >= 0 && gPresence[lIndex] == -1 )
+			{
+				gPresence[lIndex] = lValue != 0 ;
+				lCount ++ ;
+			}
+		}
+	}
+	fclose( lIn ) ;
+
+	if ( lCount != (int) PROBED_COUNT )
+	{
+		memset( gPresence , -1 , sizeof( gPresence ) ) ;
+		return 0 ;
+	}
+	return 1 ;
+}
+
+
+static void writePresenceCache( unsigned long long aKey )
+{
+	char lPath[MAX_PATH_OR_CMD] ;
+	char lTemporary[MAX_PATH_OR_CMD + 16] ;
+	size_t i ;
+	FILE * lOut ;
+
+	if ( ! presenceCachePath( lPath , sizeof( lPath ) ) ) return ;
+	snprintf( lTemporary , sizeof( lTemporary ) , "%s.%d" , lPath , (int) getpid() ) ;
+	if ( ! ( lOut = fopen( lTemporary , "w" ) ) ) return ;
+
+	fprintf( lOut , "tinyfd-presence %llx\n" , aKey ) ;
+	for ( i = 0 ; i < PROBED_COUNT ; i ++ )
+	{
+		fprintf( lOut , "%s %d\n" , gProbedExecutables[i] , gPresence[i] ) ;
+	}
+	if ( fclose( lOut ) || rename( lTemporary , lPath ) ) remove( lTemporary ) ;
+}
+
+
+/* gPresenceMutex must be held */
+static void detectAllPresences(void)
+{
+	unsigned long long lKey ;
+	size_t i ;
+
+	if ( gPresenceKnown ) return ;
+	gPresenceKnown = 1 ;
+
+	memset( gPresence , -1 , sizeof( gPresence ) ) ;
+	lKey = pathKey() ;
+	if ( readPresenceCache( lKey ) ) return ;
+
+	for ( i = 0 ; i < PROBED_COUNT ; i ++ )
+	{
+		gPresence[i] = (signed char) searchPath( gProbedExecutables[i] ) ;
+	}
+	writePresenceCache( lKey ) ;
+}
+
+
+static void * detectPresenceThread( void * aUnused )
+{
+	(void) aUnused ;
+	pthread_mutex_lock( & gPresenceMutex ) ;
+	detectAllPresences() ;
+	pthread_mutex_unlock( & gPresenceMutex ) ;
+	return NULL ;
+}
+
+
+void tinyfd_detectPresenceAsync(void)
+{
+	pthread_t lThread ;
+	if ( ! pthread_create( & lThread , NULL , detectPresenceThread , NULL ) )
+	{
+		pthread_detach( lThread ) ;
+	}
+}
+
+
+static int detectPresence( char const * aExecutable )
+{
+	int lIndex = probedIndex( aExecutable ) ;
+	int lPresent ;
+
+	pthread_mutex_lock( & gPresenceMutex ) ;
+	detectAllPresences() ;
+	lPresent = lIndex >= 0 ? gPresence[lIndex] : searchPath( aExecutable ) ;
+	pthread_mutex_unlock( & gPresenceMutex ) ;
+
+	if (tinyfd_verbose) printf("detectPresence %s %d\n", aExecutable, lPresent);
+	return lPresent ;
 }
 
 
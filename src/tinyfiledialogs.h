@@ -118,6 +118,10 @@ for graphic mode:
 for console mode:
   dialog whiptail basicinput no_solution */
 
+void tinyfd_detectPresenceAsync(void);
+/* on unix, looks for the dialog programs (zenity, kdialog...) on a background thread,
+so the first dialog does not wait for it. the result is cached in ~/.cache */
+
 void tinyfd_beep(void);
 
 int tinyfd_notifyPopup(